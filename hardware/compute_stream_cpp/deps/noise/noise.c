@@ -42,7 +42,8 @@ const static float GRAD3[16][3] = {
     { 1, 0,-1}, {-1, 0,-1}, { 0,-1, 1}, { 0, 1, 1}
 };
 
-static unsigned char PERM[] = {
+// padded so 32-bit gathers at the last index stay in bounds
+static unsigned char PERM[512 + 3] = {
     151, 160, 137,  91,  90,  15, 131,  13,
     201,  95,  96,  53, 194, 233,   7, 225,
     140,  36, 103,  30,  69, 142,   8,  99,
@@ -270,3 +271,299 @@ float simplex3(
     }
     return (1 + total / max) / 2;
 }
+
+// batch versions evaluate whole rows of samples. they produce exactly the
+// same floats as the scalar functions: every lane performs the same
+// operations in the same order, and fma is not enabled so nothing fuses.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if NOISE_AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256i perm8(__m256i index) {
+    __m256i value = _mm256_i32gather_epi32((const int *)PERM, index, 1);
+    return _mm256_and_si256(value, _mm256_set1_epi32(255));
+}
+
+AVX2 static __m256i grad8(__m256i value) {
+    // value % 12 for value < 256, times 3 to index GRAD3 rows
+    __m256i q = _mm256_srli_epi32(
+        _mm256_mullo_epi32(value, _mm256_set1_epi32(683)), 13);
+    __m256i g = _mm256_sub_epi32(
+        value, _mm256_mullo_epi32(q, _mm256_set1_epi32(12)));
+    return _mm256_mullo_epi32(g, _mm256_set1_epi32(3));
+}
+
+AVX2 static __m256 grad8_ps(__m256i row, int c) {
+    return _mm256_i32gather_ps(
+        (const float *)GRAD3 + c, row, 4);
+}
+
+AVX2 static __m256 noise2_avx2(__m256 x, __m256 y) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 s = _mm256_mul_ps(_mm256_add_ps(x, y), _mm256_set1_ps(F2));
+    __m256 i = _mm256_floor_ps(_mm256_add_ps(x, s));
+    __m256 j = _mm256_floor_ps(_mm256_add_ps(y, s));
+    __m256 t = _mm256_mul_ps(_mm256_add_ps(i, j), _mm256_set1_ps(G2));
+    __m256 xx[3], yy[3];
+    xx[0] = _mm256_sub_ps(x, _mm256_sub_ps(i, t));
+    yy[0] = _mm256_sub_ps(y, _mm256_sub_ps(j, t));
+    __m256 mi1 = _mm256_cmp_ps(xx[0], yy[0], _CMP_GT_OQ);
+    __m256 mj1 = _mm256_cmp_ps(xx[0], yy[0], _CMP_LE_OQ);
+    __m256 i1 = _mm256_and_ps(mi1, one);
+    __m256 j1 = _mm256_and_ps(mj1, one);
+    xx[2] = _mm256_sub_ps(
+        _mm256_add_ps(xx[0], _mm256_set1_ps(G2 * 2.0f)), one);
+    yy[2] = _mm256_sub_ps(
+        _mm256_add_ps(yy[0], _mm256_set1_ps(G2 * 2.0f)), one);
+    xx[1] = _mm256_add_ps(_mm256_sub_ps(xx[0], i1), _mm256_set1_ps(G2));
+    yy[1] = _mm256_add_ps(_mm256_sub_ps(yy[0], j1), _mm256_set1_ps(G2));
+    __m256i mask = _mm256_set1_epi32(255);
+    __m256i I = _mm256_and_si256(_mm256_cvttps_epi32(i), mask);
+    __m256i J = _mm256_and_si256(_mm256_cvttps_epi32(j), mask);
+    __m256i I1 = _mm256_cvttps_epi32(i1);
+    __m256i J1 = _mm256_cvttps_epi32(j1);
+    __m256i ione = _mm256_set1_epi32(1);
+    __m256i g[3];
+    g[0] = grad8(perm8(_mm256_add_epi32(I, perm8(J))));
+    g[1] = grad8(perm8(_mm256_add_epi32(_mm256_add_epi32(I, I1),
+        perm8(_mm256_add_epi32(J, J1)))));
+    g[2] = grad8(perm8(_mm256_add_epi32(_mm256_add_epi32(I, ione),
+        perm8(_mm256_add_epi32(J, ione)))));
+    __m256 noise[3];
+    for (int c = 0; c <= 2; c++) {
+        __m256 f = _mm256_sub_ps(
+            _mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(xx[c], xx[c])),
+            _mm256_mul_ps(yy[c], yy[c]));
+        __m256 f4 = _mm256_mul_ps(
+            _mm256_mul_ps(_mm256_mul_ps(f, f), f), f);
+        __m256 dot = _mm256_add_ps(
+            _mm256_mul_ps(grad8_ps(g[c], 0), xx[c]),
+            _mm256_mul_ps(grad8_ps(g[c], 1), yy[c]));
+        noise[c] = _mm256_and_ps(
+            _mm256_cmp_ps(f, zero, _CMP_GT_OQ), _mm256_mul_ps(f4, dot));
+    }
+    return _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(noise[0], noise[1]), noise[2]),
+        _mm256_set1_ps(70.0f));
+}
+
+AVX2 static __m256 noise3_avx2(__m256 x, __m256 y, __m256 z) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 s = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(x, y), z), _mm256_set1_ps(F3));
+    __m256 i = _mm256_floor_ps(_mm256_add_ps(x, s));
+    __m256 j = _mm256_floor_ps(_mm256_add_ps(y, s));
+    __m256 k = _mm256_floor_ps(_mm256_add_ps(z, s));
+    __m256 t = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(i, j), k), _mm256_set1_ps(G3));
+    __m256 pos[4][3];
+    pos[0][0] = _mm256_sub_ps(x, _mm256_sub_ps(i, t));
+    pos[0][1] = _mm256_sub_ps(y, _mm256_sub_ps(j, t));
+    pos[0][2] = _mm256_sub_ps(z, _mm256_sub_ps(k, t));
+    // the branches of the scalar version as lane masks
+    __m256 a = _mm256_cmp_ps(pos[0][0], pos[0][1], _CMP_GE_OQ);
+    __m256 b = _mm256_cmp_ps(pos[0][1], pos[0][2], _CMP_GE_OQ);
+    __m256 c = _mm256_cmp_ps(pos[0][0], pos[0][2], _CMP_GE_OQ);
+    __m256 all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    __m256 o1[3], o2[3];
+    o1[0] = _mm256_and_ps(a, _mm256_or_ps(b, c));
+    o1[1] = _mm256_andnot_ps(a, b);
+    o1[2] = _mm256_andnot_ps(_mm256_or_ps(b, _mm256_and_ps(a, c)), all);
+    o2[0] = _mm256_or_ps(a, _mm256_and_ps(b, c));
+    o2[1] = _mm256_or_ps(b, _mm256_andnot_ps(a, all));
+    o2[2] = _mm256_andnot_ps(_mm256_and_ps(b, _mm256_or_ps(a, c)), all);
+    for (int n = 0; n <= 2; n++) {
+        o1[n] = _mm256_and_ps(o1[n], one);
+        o2[n] = _mm256_and_ps(o2[n], one);
+    }
+    for (int n = 0; n <= 2; n++) {
+        pos[3][n] = _mm256_add_ps(_mm256_sub_ps(pos[0][n], one),
+            _mm256_set1_ps(3.0f * G3));
+        pos[2][n] = _mm256_add_ps(_mm256_sub_ps(pos[0][n], o2[n]),
+            _mm256_set1_ps(2.0f * G3));
+        pos[1][n] = _mm256_add_ps(_mm256_sub_ps(pos[0][n], o1[n]),
+            _mm256_set1_ps(G3));
+    }
+    __m256i mask = _mm256_set1_epi32(255);
+    __m256i ione = _mm256_set1_epi32(1);
+    __m256i I = _mm256_and_si256(_mm256_cvttps_epi32(i), mask);
+    __m256i J = _mm256_and_si256(_mm256_cvttps_epi32(j), mask);
+    __m256i K = _mm256_and_si256(_mm256_cvttps_epi32(k), mask);
+    __m256i a1[3], a2[3];
+    for (int n = 0; n <= 2; n++) {
+        a1[n] = _mm256_cvttps_epi32(o1[n]);
+        a2[n] = _mm256_cvttps_epi32(o2[n]);
+    }
+    __m256i g[4];
+    g[0] = grad8(perm8(_mm256_add_epi32(I, perm8(
+        _mm256_add_epi32(J, perm8(K))))));
+    g[1] = grad8(perm8(_mm256_add_epi32(_mm256_add_epi32(I, a1[0]),
+        perm8(_mm256_add_epi32(_mm256_add_epi32(J, a1[1]),
+        perm8(_mm256_add_epi32(a1[2], K)))))));
+    g[2] = grad8(perm8(_mm256_add_epi32(_mm256_add_epi32(I, a2[0]),
+        perm8(_mm256_add_epi32(_mm256_add_epi32(J, a2[1]),
+        perm8(_mm256_add_epi32(a2[2], K)))))));
+    g[3] = grad8(perm8(_mm256_add_epi32(_mm256_add_epi32(I, ione),
+        perm8(_mm256_add_epi32(_mm256_add_epi32(J, ione),
+        perm8(_mm256_add_epi32(K, ione)))))));
+    __m256 noise[4];
+    for (int n = 0; n <= 3; n++) {
+        __m256 f = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(
+            _mm256_set1_ps(0.6f),
+            _mm256_mul_ps(pos[n][0], pos[n][0])),
+            _mm256_mul_ps(pos[n][1], pos[n][1])),
+            _mm256_mul_ps(pos[n][2], pos[n][2]));
+        __m256 f4 = _mm256_mul_ps(
+            _mm256_mul_ps(_mm256_mul_ps(f, f), f), f);
+        __m256 dot = _mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(pos[n][0], grad8_ps(g[n], 0)),
+            _mm256_mul_ps(pos[n][1], grad8_ps(g[n], 1))),
+            _mm256_mul_ps(pos[n][2], grad8_ps(g[n], 2)));
+        noise[n] = _mm256_and_ps(
+            _mm256_cmp_ps(f, zero, _CMP_GT_OQ), _mm256_mul_ps(f4, dot));
+    }
+    return _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+        noise[0], noise[1]), noise[2]), noise[3]), _mm256_set1_ps(32.0f));
+}
+
+AVX2 static __m256 simplex2_avx2(
+    __m256 x, __m256 y, int octaves, float persistence, float lacunarity)
+{
+    float freq = 1.0f;
+    float amp = 1.0f;
+    float max = 1.0f;
+    __m256 total = noise2_avx2(x, y);
+    for (int i = 1; i < octaves; i++) {
+        freq *= lacunarity;
+        amp *= persistence;
+        max += amp;
+        __m256 f = _mm256_set1_ps(freq);
+        total = _mm256_add_ps(total, _mm256_mul_ps(noise2_avx2(
+            _mm256_mul_ps(x, f), _mm256_mul_ps(y, f)), _mm256_set1_ps(amp)));
+    }
+    return _mm256_div_ps(_mm256_add_ps(_mm256_set1_ps(1.0f),
+        _mm256_div_ps(total, _mm256_set1_ps(max))), _mm256_set1_ps(2.0f));
+}
+
+AVX2 static __m256 simplex3_avx2(
+    __m256 x, __m256 y, __m256 z,
+    int octaves, float persistence, float lacunarity)
+{
+    float freq = 1.0f;
+    float amp = 1.0f;
+    float max = 1.0f;
+    __m256 total = noise3_avx2(x, y, z);
+    for (int i = 1; i < octaves; i++) {
+        freq *= lacunarity;
+        amp *= persistence;
+        max += amp;
+        __m256 f = _mm256_set1_ps(freq);
+        total = _mm256_add_ps(total, _mm256_mul_ps(noise3_avx2(
+            _mm256_mul_ps(x, f), _mm256_mul_ps(y, f), _mm256_mul_ps(z, f)),
+            _mm256_set1_ps(amp)));
+    }
+    return _mm256_div_ps(_mm256_add_ps(_mm256_set1_ps(1.0f),
+        _mm256_div_ps(total, _mm256_set1_ps(max))), _mm256_set1_ps(2.0f));
+}
+
+AVX2 static void simplex2_batch_avx2(
+    const float *x, const float *y, float *out, int count,
+    int octaves, float persistence, float lacunarity)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(out + i, simplex2_avx2(
+            _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i),
+            octaves, persistence, lacunarity));
+    }
+    if (i < count) {
+        float tx[8] = {0}, ty[8] = {0}, tout[8];
+        memcpy(tx, x + i, sizeof(float) * (count - i));
+        memcpy(ty, y + i, sizeof(float) * (count - i));
+        _mm256_storeu_ps(tout, simplex2_avx2(
+            _mm256_loadu_ps(tx), _mm256_loadu_ps(ty),
+            octaves, persistence, lacunarity));
+        memcpy(out + i, tout, sizeof(float) * (count - i));
+    }
+}
+
+AVX2 static void simplex3_batch_avx2(
+    const float *x, const float *y, const float *z, float *out, int count,
+    int octaves, float persistence, float lacunarity)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(out + i, simplex3_avx2(
+            _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i),
+            _mm256_loadu_ps(z + i), octaves, persistence, lacunarity));
+    }
+    if (i < count) {
+        float tx[8] = {0}, ty[8] = {0}, tz[8] = {0}, tout[8];
+        memcpy(tx, x + i, sizeof(float) * (count - i));
+        memcpy(ty, y + i, sizeof(float) * (count - i));
+        memcpy(tz, z + i, sizeof(float) * (count - i));
+        _mm256_storeu_ps(tout, simplex3_avx2(
+            _mm256_loadu_ps(tx), _mm256_loadu_ps(ty), _mm256_loadu_ps(tz),
+            octaves, persistence, lacunarity));
+        memcpy(out + i, tout, sizeof(float) * (count - i));
+    }
+}
+
+static int noise_avx2 = -1;
+
+static int has_avx2() {
+    if (noise_avx2 < 0) {
+        __builtin_cpu_init();
+        noise_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return noise_avx2;
+}
+
+#endif
+
+void simplex_batch_enable(int enabled) {
+#if NOISE_AVX2
+    noise_avx2 = enabled ? -1 : 0;
+#endif
+}
+
+void simplex2_batch(
+    const float *x, const float *y, float *out, int count,
+    int octaves, float persistence, float lacunarity)
+{
+#if NOISE_AVX2
+    if (has_avx2()) {
+        simplex2_batch_avx2(
+            x, y, out, count, octaves, persistence, lacunarity);
+        return;
+    }
+#endif
+    for (int i = 0; i < count; i++) {
+        out[i] = simplex2(x[i], y[i], octaves, persistence, lacunarity);
+    }
+}
+
+void simplex3_batch(
+    const float *x, const float *y, const float *z, float *out, int count,
+    int octaves, float persistence, float lacunarity)
+{
+#if NOISE_AVX2
+    if (has_avx2()) {
+        simplex3_batch_avx2(
+            x, y, z, out, count, octaves, persistence, lacunarity);
+        return;
+    }
+#endif
+    for (int i = 0; i < count; i++) {
+        out[i] = simplex3(
+            x[i], y[i], z[i], octaves, persistence, lacunarity);
+    }
+}
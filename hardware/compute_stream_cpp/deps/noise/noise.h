@@ -37,4 +37,17 @@ float simplex3(
     float x, float y, float z,
     int octaves, float persistence, float lacunarity);
 
+// evaluate count samples at once, bit-identical to the scalar versions;
+// uses AVX2 when the cpu has it
+void simplex2_batch(
+    const float *x, const float *y, float *out, int count,
+    int octaves, float persistence, float lacunarity);
+
+void simplex3_batch(
+    const float *x, const float *y, const float *z, float *out, int count,
+    int octaves, float persistence, float lacunarity);
+
+// 0 forces the scalar path, 1 restores cpu detection
+void simplex_batch_enable(int enabled);
+
 #endif
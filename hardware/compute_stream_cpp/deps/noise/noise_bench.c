@@ -0,0 +1,73 @@
+/*
+Compares the scalar and batch noise paths: checks that they agree bit for
+bit and times create_world with each.
+
+    gcc -std=c99 -O3 -I src -I deps/noise -o noise_bench \
+        deps/noise/noise_bench.c deps/noise/noise.c src/world.c -lm
+    ./noise_bench [CHUNKS]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "noise.h"
+#include "world.h"
+
+#define SAMPLES 1000
+
+static void count_block(int x, int y, int z, int w, void *arg) {
+    (*(long *)arg)++;
+}
+
+static int check() {
+    float x[SAMPLES], y[SAMPLES], z[SAMPLES], out[SAMPLES];
+    int errors = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+        x[i] = (rand() / (float)RAND_MAX - 0.5f) * 2000;
+        y[i] = (rand() / (float)RAND_MAX - 0.5f) * 2000;
+        z[i] = (rand() / (float)RAND_MAX - 0.5f) * 2000;
+    }
+    for (int octaves = 1; octaves <= 8; octaves++) {
+        simplex2_batch(x, y, out, SAMPLES, octaves, 0.5, 2);
+        for (int i = 0; i < SAMPLES; i++) {
+            float expected = simplex2(x[i], y[i], octaves, 0.5, 2);
+            errors += memcmp(&expected, out + i, sizeof(float)) != 0;
+        }
+        simplex3_batch(x, y, z, out, SAMPLES, octaves, 0.5, 2);
+        for (int i = 0; i < SAMPLES; i++) {
+            float expected = simplex3(x[i], y[i], z[i], octaves, 0.5, 2);
+            errors += memcmp(&expected, out + i, sizeof(float)) != 0;
+        }
+    }
+    return errors;
+}
+
+static double bench(int chunks, long *blocks) {
+    clock_t start = clock();
+    for (int i = 0; i < chunks; i++) {
+        create_world(i % 16, i / 16, count_block, blocks);
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    return chunks / elapsed;
+}
+
+int main(int argc, char **argv) {
+    int chunks = argc > 1 ? atoi(argv[1]) : 256;
+    int errors = check();
+    printf("batch mismatches: %d\n", errors);
+    long scalar_blocks = 0;
+    long batch_blocks = 0;
+    simplex_batch_enable(0);
+    double scalar = bench(chunks, &scalar_blocks);
+    simplex_batch_enable(1);
+    double batch = bench(chunks, &batch_blocks);
+    printf("scalar: %.1f chunks/s\n", scalar);
+    printf("batch:  %.1f chunks/s (%.2fx)\n", batch, batch / scalar);
+    if (scalar_blocks != batch_blocks) {
+        printf("block counts differ: %ld vs %ld\n",
+            scalar_blocks, batch_blocks);
+        errors++;
+    }
+    return errors ? 1 : 0;
+}
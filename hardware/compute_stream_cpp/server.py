@@ -7,6 +7,7 @@ import random
 import re
 import requests
 import sqlite3
+import struct
 import sys
 import threading
 import time
@@ -22,6 +23,12 @@ CHUNK_SIZE = 32
 BUFFER_SIZE = 4096
 COMMIT_INTERVAL = 5
 
+PROTOCOL_VERSIONS = (1, 2)
+FRAME_TEXT = 'T'
+FRAME_CHUNK = 'C'
+MAX_FRAME_RUNS = 16384
+MAX_TEXT_FRAME = 65536
+
 AUTH_REQUIRED = True
 AUTH_URL = 'https://craft.michaelfogleman.com/api/1/access'
 
@@ -38,6 +45,7 @@ ALLOWED_ITEMS = set([
 
 AUTHENTICATE = 'A'
 BLOCK = 'B'
+CANCEL = 'X'
 CHUNK = 'C'
 DISCONNECT = 'D'
 KEY = 'K'
@@ -69,6 +77,42 @@ def chunked(x):
 def packet(*args):
     return '%s\n' % ','.join(map(str, args))
 
+def frame(kind, payload):
+    return struct.pack('<IB', len(payload), ord(kind)) + payload
+
+def text_frames(data):
+    # split at line boundaries so no frame outgrows the client's buffer
+    result = []
+    while len(data) > MAX_TEXT_FRAME:
+        index = data.rindex('\n', 0, MAX_TEXT_FRAME) + 1
+        result.append(frame(FRAME_TEXT, data[:index]))
+        data = data[index:]
+    if data:
+        result.append(frame(FRAME_TEXT, data))
+    return ''.join(result)
+
+def encode_runs(blocks):
+    # blocks are (dx, dz, y, w) tuples; vertical runs of equal w are merged
+    runs = []
+    for dx, dz, y, w in sorted(blocks):
+        if runs:
+            rx, rz, ry, rn, rw = runs[-1]
+            if (rx, rz, rw) == (dx, dz, w) and ry + rn == y and rn < 255:
+                runs[-1] = (rx, rz, ry, rn + 1, rw)
+                continue
+        runs.append((dx, dz, y, 1, w))
+    return runs
+
+def chunk_frames(p, q, blocks):
+    runs = encode_runs(blocks)
+    result = []
+    for i in xrange(0, len(runs), MAX_FRAME_RUNS):
+        batch = runs[i:i + MAX_FRAME_RUNS]
+        data = [struct.pack('<iiI', p, q, len(batch))]
+        data.extend(struct.pack('<BBBBb', *run) for run in batch)
+        result.append(frame(FRAME_CHUNK, ''.join(data)))
+    return result
+
 class RateLimiter(object):
     def __init__(self, rate, per):
         self.rate = float(rate)
@@ -99,9 +143,13 @@ class Handler(SocketServer.BaseRequestHandler):
         self.position_limiter = RateLimiter(100, 5)
         self.limiter = RateLimiter(1000, 10)
         self.version = None
+        self.binary = False
         self.client_id = None
         self.user_id = None
         self.nick = None
+        self.requested = 0
+        self.answered = 0
+        self.cancelled = {}
         self.queue = Queue.Queue()
         self.running = True
         self.start()
@@ -131,9 +179,27 @@ class Handler(SocketServer.BaseRequestHandler):
                             log('RATE', self.client_id)
                             self.stop()
                             return
+                    if self.on_cancel(line):
+                        continue
                     model.enqueue(model.on_data, self, line)
         finally:
             model.enqueue(model.on_disconnect, self)
+    def on_cancel(self, line):
+        # requests are numbered in the order they are queued and answered
+        # in that order on the model thread, a cancel covers the requests
+        # for its chunk queued before it
+        args = line.split(',')
+        if args[0] == CHUNK:
+            self.requested += 1
+            return False
+        if args[0] != CANCEL:
+            return False
+        try:
+            key = (int(args[1]), int(args[2]))
+        except (IndexError, ValueError):
+            return True
+        self.cancelled[key] = self.requested
+        return True
     def finish(self):
         self.running = False
     def stop(self):
@@ -162,7 +228,12 @@ class Handler(SocketServer.BaseRequestHandler):
                 raise
     def send_raw(self, data):
         if data:
+            if self.binary:
+                data = text_frames(data)
             self.queue.put(data)
+    def send_frames(self, frames):
+        if frames:
+            self.queue.put(''.join(frames))
     def send(self, *args):
         self.send_raw(packet(*args))
 
@@ -300,6 +371,8 @@ class Model(object):
         #log('RECV', client.client_id, data)
         args = data.split(',')
         command, args = args[0], args[1:]
+        if command == CHUNK:
+            client.answered += 1
         if command in self.commands:
             func = self.commands[command]
             func(client, *args)
@@ -312,10 +385,14 @@ class Model(object):
         if client.version is not None:
             return
         version = int(version)
-        if version != 1:
+        if version not in PROTOCOL_VERSIONS:
             client.stop()
             return
         client.version = version
+        if version > 1:
+            # everything after the ack is framed
+            client.send(VERSION, version)
+            client.binary = True
         # TODO: client.start() here
     def on_authenticate(self, client, username, access_token):
         user_id = None
@@ -339,6 +416,8 @@ class Model(object):
     def on_chunk(self, client, p, q, key=0):
         packets = []
         p, q, key = map(int, (p, q, key))
+        if client.answered <= client.cancelled.get((p, q), 0):
+            return
         query = (
             'select rowid, x, y, z, w from block where '
             'p = :p and q = :q and rowid > :key;'
@@ -346,10 +425,17 @@ class Model(object):
         rows = self.execute(query, dict(p=p, q=q, key=key))
         max_rowid = 0
         blocks = 0
+        runs = []
         for rowid, x, y, z, w in rows:
             blocks += 1
-            packets.append(packet(BLOCK, p, q, x, y, z, w))
             max_rowid = max(max_rowid, rowid)
+            dx = x - p * CHUNK_SIZE + 1
+            dz = z - q * CHUNK_SIZE + 1
+            if (client.binary and 0 <= dx < 256 and 0 <= dz < 256 and
+                    0 <= y < 256 and -128 <= w < 128):
+                runs.append((dx, dz, y, w))
+            else:
+                packets.append(packet(BLOCK, p, q, x, y, z, w))
         query = (
             'select x, y, z, w from light where '
             'p = :p and q = :q;'
@@ -373,6 +459,7 @@ class Model(object):
         if blocks or lights or signs:
             packets.append(packet(REDRAW, p, q))
         packets.append(packet(CHUNK, p, q))
+        client.send_frames(chunk_frames(p, q, runs))
         client.send_raw(''.join(packets))
     def on_block(self, client, x, y, z, w):
         x, y, z, w = map(int, (x, y, z, w))
@@ -0,0 +1,398 @@
+#define _XOPEN_SOURCE 600
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "client.h"
+#include "config.h"
+
+#define MAX_LOAD_CLIENTS 1024
+#define HAVE_SIZE 4096
+#define MAX_SAMPLES 1048576
+#define RECV_SIZE 65536
+#define POSITION_INTERVAL 0.1
+#define WALK_SPEED 8.0
+
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0
+#endif
+
+typedef struct {
+    int p;
+    int q;
+    double time;
+} Request;
+
+typedef struct {
+    int fd;
+    int framed;
+    char *in;
+    int in_size;
+    int in_capacity;
+    double x, z, dx, dz;
+    double last_position;
+    double last_edit;
+    int center_p;
+    int center_q;
+    int spiral;
+    int have[HAVE_SIZE];
+    Request *requests;
+    int request_count;
+} LoadClient;
+
+static LoadClient load_clients[MAX_LOAD_CLIENTS];
+static float samples[MAX_SAMPLES];
+static int sample_count = 0;
+static long chunk_count = 0;
+static long byte_count = 0;
+static long edit_count = 0;
+static int window = CHUNK_REQUEST_WINDOW;
+static int radius = 6;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int chunked(double x) {
+    return (int)floor(round(x) / CHUNK_SIZE);
+}
+
+static void send_all(LoadClient *c, const char *data) {
+    int length = strlen(data);
+    while (length > 0) {
+        int n = send(c->fd, data, length, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EAGAIN) {
+                struct pollfd fd = {c->fd, POLLOUT, 0};
+                poll(&fd, 1, 100);
+                continue;
+            }
+            return;
+        }
+        data += n;
+        length -= n;
+    }
+}
+
+// each client remembers which chunks it has asked for in a small
+// open addressed set keyed on (p, q)
+static int have_chunk(LoadClient *c, int p, int q) {
+    int key = ((p & 0xffff) << 16) | (q & 0xffff);
+    unsigned int index = ((unsigned int)key * 2654435761u) % HAVE_SIZE;
+    for (int i = 0; i < HAVE_SIZE; i++) {
+        int *entry = c->have + (index + i) % HAVE_SIZE;
+        if (*entry == key) {
+            return 1;
+        }
+        if (*entry == -1) {
+            *entry = key;
+            return 0;
+        }
+    }
+    memset(c->have, -1, sizeof(c->have));
+    return 0;
+}
+
+static void spiral_offset(int index, int *dp, int *dq) {
+    // ring r holds 8r cells starting at (-r, -r) and walking clockwise
+    if (index == 0) {
+        *dp = *dq = 0;
+        return;
+    }
+    int r = 1;
+    while (index > 8 * r) {
+        index -= 8 * r;
+        r++;
+    }
+    index--;
+    int side = index / (2 * r);
+    int step = index % (2 * r);
+    switch (side) {
+        case 0: *dp = -r + step; *dq = -r; break;
+        case 1: *dp = r; *dq = -r + step; break;
+        case 2: *dp = r - step; *dq = r; break;
+        default: *dp = -r; *dq = r - step; break;
+    }
+}
+
+static void request_chunks(LoadClient *c, double t) {
+    int cells = (2 * radius + 1) * (2 * radius + 1);
+    int p = chunked(c->x);
+    int q = chunked(c->z);
+    if (p != c->center_p || q != c->center_q) {
+        c->center_p = p;
+        c->center_q = q;
+        c->spiral = 0;
+    }
+    while (c->request_count < window && c->spiral < cells) {
+        int dp, dq;
+        spiral_offset(c->spiral++, &dp, &dq);
+        if (have_chunk(c, p + dp, q + dq)) {
+            continue;
+        }
+        char line[64];
+        snprintf(line, sizeof(line), "C,%d,%d\n", p + dp, q + dq);
+        send_all(c, line);
+        Request *request = c->requests + c->request_count++;
+        request->p = p + dp;
+        request->q = q + dq;
+        request->time = t;
+    }
+}
+
+static void on_chunk_done(LoadClient *c, int p, int q, double t) {
+    for (int i = 0; i < c->request_count; i++) {
+        Request *request = c->requests + i;
+        if (request->p == p && request->q == q) {
+            if (sample_count < MAX_SAMPLES) {
+                samples[sample_count++] = t - request->time;
+            }
+            chunk_count++;
+            *request = c->requests[--c->request_count];
+            return;
+        }
+    }
+}
+
+static void on_lines(LoadClient *c, char *data, int length, double t) {
+    int start = 0;
+    for (int i = 0; i < length; i++) {
+        if (data[i] != '\n') {
+            continue;
+        }
+        int p, q;
+        data[i] = '\0';
+        if (data[start] == 'C' &&
+            sscanf(data + start, "C,%d,%d", &p, &q) == 2)
+        {
+            on_chunk_done(c, p, q, t);
+        }
+        start = i + 1;
+    }
+}
+
+static int on_readable(LoadClient *c, double t) {
+    if (c->in_capacity - c->in_size < RECV_SIZE) {
+        c->in_capacity = c->in_size + RECV_SIZE * 2;
+        c->in = realloc(c->in, c->in_capacity);
+    }
+    int n = recv(c->fd, c->in + c->in_size, c->in_capacity - c->in_size, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN)) {
+        return -1;
+    }
+    if (n < 0) {
+        return 0;
+    }
+    byte_count += n;
+    c->in_size += n;
+    int start = 0;
+    while (start < c->in_size) {
+        char *data = c->in + start;
+        int remaining = c->in_size - start;
+        if (!c->framed) {
+            char *end = memchr(data, '\n', remaining);
+            if (!end) {
+                break;
+            }
+            int length = end - data + 1;
+            if (strncmp(data, "V,", 2) == 0) {
+                c->framed = 1;
+            }
+            on_lines(c, data, length, t);
+            start += length;
+            continue;
+        }
+        if (remaining < 5) {
+            break;
+        }
+        unsigned char *header = (unsigned char *)data;
+        int length = header[0] | header[1] << 8 |
+            header[2] << 16 | header[3] << 24;
+        if (remaining < 5 + length) {
+            break;
+        }
+        if (data[4] == FRAME_TEXT) {
+            on_lines(c, data + 5, length, t);
+        }
+        start += 5 + length;
+    }
+    c->in_size -= start;
+    memmove(c->in, c->in + start, c->in_size);
+    return 0;
+}
+
+static int connect_client(LoadClient *c, const char *host, int port,
+    int version)
+{
+    struct hostent *entry = gethostbyname(host);
+    struct sockaddr_in address;
+    if (!entry) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = ((struct in_addr *)(entry->h_addr_list[0]))
+        ->s_addr;
+    address.sin_port = htons(port);
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0 ||
+        connect(c->fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL, 0) | O_NONBLOCK);
+    char line[64];
+    snprintf(line, sizeof(line), "V,%d\nA,load%d,\n", version,
+        (int)(c - load_clients));
+    send_all(c, line);
+    double angle = (rand() % 360) * M_PI / 180;
+    c->dx = cos(angle) * WALK_SPEED;
+    c->dz = sin(angle) * WALK_SPEED;
+    c->x = c->z = 0;
+    c->center_p = c->center_q = 0x7fffffff;
+    memset(c->have, -1, sizeof(c->have));
+    c->requests = calloc(window, sizeof(Request));
+    return 0;
+}
+
+static void walk(LoadClient *c, double t, double dt, int edits) {
+    c->x += c->dx * dt;
+    c->z += c->dz * dt;
+    char line[128];
+    if (t - c->last_position >= POSITION_INTERVAL) {
+        c->last_position = t;
+        snprintf(line, sizeof(line), "P,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+            c->x, 40.0, c->z, 0.0, 0.0);
+        send_all(c, line);
+    }
+    if (edits && t - c->last_edit >= 1.0 / edits) {
+        c->last_edit = t;
+        int x = (int)round(c->x) + rand() % 16 - 8;
+        int z = (int)round(c->z) + rand() % 16 - 8;
+        snprintf(line, sizeof(line), "B,%d,%d,%d,%d\nB,%d,%d,%d,0\n",
+            x, 200, z, 1 + rand() % 15, x, 200, z);
+        send_all(c, line);
+        edit_count += 2;
+    }
+}
+
+static int sample_compare(const void *a, const void *b) {
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+    const char *host = "localhost";
+    int port = DEFAULT_PORT;
+    int count = 16;
+    int seconds = 30;
+    int edits = 1;
+    int version = PROTOCOL_BINARY;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-clients") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-seconds") == 0 && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-radius") == 0 && i + 1 < argc) {
+            radius = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-window") == 0 && i + 1 < argc) {
+            window = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-edits") == 0 && i + 1 < argc) {
+            edits = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-text") == 0) {
+            version = PROTOCOL_TEXT;
+        }
+        else if (positional++ == 0) {
+            host = argv[i];
+        }
+        else {
+            port = atoi(argv[i]);
+        }
+    }
+    if (count < 1 || count > MAX_LOAD_CLIENTS || window < 1) {
+        fprintf(stderr, "usage: %s [-clients N] [-seconds S] [-radius R] "
+            "[-window W] [-edits N] [-text] [HOST [PORT]]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    for (int i = 0; i < count; i++) {
+        if (connect_client(load_clients + i, host, port, version) < 0) {
+            perror("connect");
+            return 1;
+        }
+    }
+    printf("LOAD %d clients, %d seconds, radius %d, window %d\n",
+        count, seconds, radius, window);
+    static struct pollfd fds[MAX_LOAD_CLIENTS];
+    int connected = count;
+    double start = now();
+    double last = start;
+    while (connected && now() - start < seconds) {
+        for (int i = 0; i < count; i++) {
+            fds[i].fd = load_clients[i].fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        poll(fds, count, 10);
+        double t = now();
+        for (int i = 0; i < count; i++) {
+            LoadClient *c = load_clients + i;
+            if (c->fd < 0) {
+                continue;
+            }
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+                on_readable(c, t) < 0)
+            {
+                close(c->fd);
+                c->fd = -1;
+                connected--;
+                continue;
+            }
+            walk(c, t, t - last, edits);
+            request_chunks(c, t);
+        }
+        last = t;
+    }
+    double elapsed = now() - start;
+    qsort(samples, sample_count, sizeof(float), sample_compare);
+    double total = 0;
+    for (int i = 0; i < sample_count; i++) {
+        total += samples[i];
+    }
+    printf("connected: %d/%d\n", connected, count);
+    printf("chunks: %ld (%.1f/s)\n", chunk_count, chunk_count / elapsed);
+    printf("edits: %ld\n", edit_count);
+    printf("received: %.1f MB (%.1f MB/s)\n",
+        byte_count / 1048576.0, byte_count / 1048576.0 / elapsed);
+    if (sample_count) {
+        printf("latency ms: mean %.1f, p50 %.1f, p99 %.1f, max %.1f\n",
+            total / sample_count * 1000,
+            samples[sample_count / 2] * 1000,
+            samples[sample_count * 99 / 100] * 1000,
+            samples[sample_count - 1] * 1000);
+    }
+    return 0;
+}
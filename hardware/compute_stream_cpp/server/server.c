@@ -0,0 +1,1131 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "client.h"
+#include "config.h"
+#include "map.h"
+#include "store.h"
+#include "tinycthread.h"
+#include "world.h"
+
+#define DEFAULT_HOST "0.0.0.0"
+#define SERVER_DB_PATH "craft.db"
+#define MAX_CLIENTS 1024
+#define MAX_NICK_LENGTH 32
+#define DEFAULT_WORKERS 4
+#define RECV_SIZE 65536
+#define MAX_LINE_LENGTH 1024
+#define MAX_OUT_SIZE (64 * 1048576)
+#define MAX_TEXT_FRAME 65536
+#define MAX_FRAME_RUNS 16384
+#define MAX_SIGN_TEXT 48
+#define EDIT_LOG_SIZE 4096
+#define WORLD_CACHE_SIZE 64
+#define STATS_INTERVAL 10
+
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0
+#endif
+
+#define ABS(x) ((x) < 0 ? (-(x)) : (x))
+
+typedef struct {
+    char *data;
+    int size;
+    int capacity;
+} Buffer;
+
+typedef struct {
+    int fd;
+    int id;
+    unsigned int serial;
+    int version;
+    int binary;
+    char nick[MAX_NICK_LENGTH];
+    float x, y, z, rx, ry;
+    Buffer in;
+    Buffer text;
+    Buffer out;
+} Client;
+
+typedef struct {
+    int slot;
+    unsigned int serial;
+    int p;
+    int q;
+    int key;
+    int binary;
+    long edit_seq;
+} Job;
+
+typedef struct {
+    Job job;
+    Buffer frames;
+    Buffer text;
+} Result;
+
+typedef struct {
+    unsigned char dx;
+    unsigned char dz;
+    unsigned char y;
+    unsigned char n;
+    signed char w;
+} Run;
+
+typedef struct {
+    int p;
+    int q;
+    int binary;
+    int blocks;
+    Run *runs;
+    int run_count;
+    int run_capacity;
+    Buffer *text;
+} ChunkState;
+
+typedef struct {
+    long seq;
+    char type;
+    int p, q, x, y, z, w;
+    char text[MAX_SIGN_TEXT + 1];
+} Edit;
+
+typedef struct {
+    int p;
+    int q;
+    int valid;
+    Map map;
+} WorldChunk;
+
+static volatile sig_atomic_t running = 1;
+static Client clients[MAX_CLIENTS];
+static int client_count = 0;
+static Reader reader;
+
+// chunk requests are answered by a pool of workers with their own
+// read connections; results come back through a pipe to the poll loop
+static Job *jobs;
+static int job_count;
+static int job_capacity;
+static Result **results;
+static int result_count;
+static int result_capacity;
+static mtx_t job_mtx;
+static cnd_t job_cnd;
+static mtx_t result_mtx;
+static int wake_pipe[2];
+
+// recent edits, used to answer get_block before the store has committed
+// and to patch chunk responses whose snapshot the store had not caught up
+// with; every edit is marked in the store queue after its writes
+static Edit edits[EDIT_LOG_SIZE];
+static long edit_seq = 0;
+
+static WorldChunk world_cache[WORLD_CACHE_SIZE];
+
+static long stats_chunks = 0;
+static long stats_bytes = 0;
+
+static int chunked(int x) {
+    return (int)floor((double)x / CHUNK_SIZE);
+}
+
+static void buffer_append(Buffer *buffer, const char *data, int length) {
+    if (buffer->size + length > buffer->capacity) {
+        int capacity = buffer->capacity ? buffer->capacity : 1024;
+        while (capacity < buffer->size + length) {
+            capacity *= 2;
+        }
+        buffer->data = realloc(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, length);
+    buffer->size += length;
+}
+
+static void buffer_printf(Buffer *buffer, const char *format, ...) {
+    char line[MAX_LINE_LENGTH];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length >= (int)sizeof(line)) {
+        length = sizeof(line) - 1;
+    }
+    buffer_append(buffer, line, length);
+}
+
+static void buffer_consume(Buffer *buffer, int length) {
+    buffer->size -= length;
+    memmove(buffer->data, buffer->data + length, buffer->size);
+}
+
+static void buffer_free(Buffer *buffer) {
+    free(buffer->data);
+    buffer->data = 0;
+    buffer->size = buffer->capacity = 0;
+}
+
+static void append_frame(Buffer *buffer, char type, const char *data, int length) {
+    char header[5];
+    header[0] = length & 0xff;
+    header[1] = (length >> 8) & 0xff;
+    header[2] = (length >> 16) & 0xff;
+    header[3] = (length >> 24) & 0xff;
+    header[4] = type;
+    buffer_append(buffer, header, sizeof(header));
+    buffer_append(buffer, data, length);
+}
+
+// protocol output //
+
+static void flush_text(Client *client) {
+    Buffer *text = &client->text;
+    if (!text->size) {
+        return;
+    }
+    if (!client->binary) {
+        buffer_append(&client->out, text->data, text->size);
+        text->size = 0;
+        return;
+    }
+    int start = 0;
+    while (start < text->size) {
+        int end = text->size;
+        if (end - start > MAX_TEXT_FRAME) {
+            end = start + MAX_TEXT_FRAME;
+            while (end > start && text->data[end - 1] != '\n') {
+                end--;
+            }
+        }
+        append_frame(&client->out, FRAME_TEXT, text->data + start, end - start);
+        start = end;
+    }
+    text->size = 0;
+}
+
+static void send_line(Client *client, const char *format, ...) {
+    char line[MAX_LINE_LENGTH];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length >= (int)sizeof(line) - 1) {
+        length = sizeof(line) - 2;
+    }
+    line[length++] = '\n';
+    buffer_append(&client->text, line, length);
+}
+
+static void send_talk(const char *text) {
+    printf("%s\n", text);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            send_line(clients + i, "T,%s", text);
+        }
+    }
+}
+
+static void send_you(Client *client) {
+    send_line(client, "U,%d,%.2f,%.2f,%.2f,%.2f,%.2f", client->id,
+        client->x, client->y, client->z, client->rx, client->ry);
+}
+
+static void send_position(Client *client) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Client *other = clients + i;
+        if (other->fd < 0 || other == client) {
+            continue;
+        }
+        send_line(other, "P,%d,%.2f,%.2f,%.2f,%.2f,%.2f", client->id,
+            client->x, client->y, client->z, client->rx, client->ry);
+    }
+}
+
+static void send_positions(Client *client) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Client *other = clients + i;
+        if (other->fd < 0 || other == client) {
+            continue;
+        }
+        send_line(client, "P,%d,%.2f,%.2f,%.2f,%.2f,%.2f", other->id,
+            other->x, other->y, other->z, other->rx, other->ry);
+    }
+}
+
+static void send_nick(Client *client) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            send_line(clients + i, "N,%d,%s", client->id, client->nick);
+        }
+    }
+}
+
+static void send_nicks(Client *client) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Client *other = clients + i;
+        if (other->fd < 0 || other == client) {
+            continue;
+        }
+        send_line(client, "N,%d,%s", other->id, other->nick);
+    }
+}
+
+static void send_others(Client *client, const char *format, ...) {
+    char line[MAX_LINE_LENGTH];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Client *other = clients + i;
+        if (other->fd < 0 || other == client) {
+            continue;
+        }
+        send_line(other, "%s", line);
+    }
+}
+
+// world state //
+
+static void world_set(int x, int y, int z, int n, int w, void *arg) {
+    map_set_column((Map *)arg, x, y, z, n, w);
+}
+
+static int get_default_block(int x, int y, int z) {
+    int p = chunked(x);
+    int q = chunked(z);
+    WorldChunk *chunk = world_cache + ((p & 7) << 3 | (q & 7));
+    if (!chunk->valid || chunk->p != p || chunk->q != q) {
+        if (chunk->valid) {
+            map_free(&chunk->map);
+        }
+        map_alloc(&chunk->map,
+            p * CHUNK_SIZE - 1, 0, q * CHUNK_SIZE - 1, 0x7fff);
+        create_world_runs(p, q, world_set, &chunk->map);
+        chunk->p = p;
+        chunk->q = q;
+        chunk->valid = 1;
+    }
+    return map_get(&chunk->map, x, y, z);
+}
+
+static void log_edit(char type, int p, int q, int x, int y, int z, int w,
+    const char *text)
+{
+    Edit *edit = edits + (++edit_seq % EDIT_LOG_SIZE);
+    edit->seq = edit_seq;
+    edit->type = type;
+    edit->p = p; edit->q = q;
+    edit->x = x; edit->y = y; edit->z = z; edit->w = w;
+    edit->text[0] = '\0';
+    if (text) {
+        strncpy(edit->text, text, MAX_SIGN_TEXT);
+        edit->text[MAX_SIGN_TEXT] = '\0';
+    }
+    store_mark(edit_seq);
+}
+
+static int get_block(int x, int y, int z) {
+    int p = chunked(x);
+    int q = chunked(z);
+    for (long seq = edit_seq; seq > 0 && seq > edit_seq - EDIT_LOG_SIZE;
+        seq--)
+    {
+        Edit *edit = edits + (seq % EDIT_LOG_SIZE);
+        if (edit->type == 'B' && edit->x == x && edit->y == y &&
+            edit->z == z && edit->p == p && edit->q == q)
+        {
+            return edit->w;
+        }
+    }
+    int w;
+    if (store_get_block(&reader, x, y, z, &w)) {
+        return w;
+    }
+    return get_default_block(x, y, z);
+}
+
+// chunk workers //
+
+static int run_compare(const void *a, const void *b) {
+    const Run *r1 = (const Run *)a;
+    const Run *r2 = (const Run *)b;
+    if (r1->dx != r2->dx) return r1->dx - r2->dx;
+    if (r1->dz != r2->dz) return r1->dz - r2->dz;
+    return r1->y - r2->y;
+}
+
+static void chunk_block(int x, int y, int z, int w, void *arg) {
+    ChunkState *state = (ChunkState *)arg;
+    state->blocks++;
+    int dx = x - state->p * CHUNK_SIZE + 1;
+    int dz = z - state->q * CHUNK_SIZE + 1;
+    if (state->binary && dx >= 0 && dx < 256 && dz >= 0 && dz < 256 &&
+        y >= 0 && y < 256 && w >= -128 && w < 128)
+    {
+        if (state->run_count == state->run_capacity) {
+            state->run_capacity = state->run_capacity * 2 + 1024;
+            state->runs = realloc(state->runs,
+                sizeof(Run) * state->run_capacity);
+        }
+        Run *run = state->runs + state->run_count++;
+        run->dx = dx; run->dz = dz; run->y = y; run->n = 1; run->w = w;
+    }
+    else {
+        buffer_printf(state->text, "B,%d,%d,%d,%d,%d,%d\n",
+            state->p, state->q, x, y, z, w);
+    }
+}
+
+static void chunk_light(int x, int y, int z, int w, void *arg) {
+    ChunkState *state = (ChunkState *)arg;
+    state->blocks++;
+    buffer_printf(state->text, "L,%d,%d,%d,%d,%d,%d\n",
+        state->p, state->q, x, y, z, w);
+}
+
+static void chunk_sign(
+    int x, int y, int z, int face, const char *text, void *arg)
+{
+    ChunkState *state = (ChunkState *)arg;
+    state->blocks++;
+    buffer_printf(state->text, "S,%d,%d,%d,%d,%d,%d,%s\n",
+        state->p, state->q, x, y, z, face, text);
+}
+
+static void encode_runs(ChunkState *state, Buffer *frames) {
+    if (!state->run_count) {
+        return;
+    }
+    qsort(state->runs, state->run_count, sizeof(Run), run_compare);
+    int count = 1;
+    for (int i = 1; i < state->run_count; i++) {
+        Run *run = state->runs + count - 1;
+        Run *next = state->runs + i;
+        if (run->dx == next->dx && run->dz == next->dz &&
+            run->w == next->w && run->y + run->n == next->y && run->n < 255)
+        {
+            run->n++;
+        }
+        else {
+            state->runs[count++] = *next;
+        }
+    }
+    Buffer payload = {0};
+    for (int start = 0; start < count; start += MAX_FRAME_RUNS) {
+        int n = count - start < MAX_FRAME_RUNS ? count - start : MAX_FRAME_RUNS;
+        int header[3] = {state->p, state->q, n};
+        payload.size = 0;
+        for (int i = 0; i < 3; i++) {
+            unsigned int value = header[i];
+            char bytes[4] = {
+                value & 0xff, (value >> 8) & 0xff,
+                (value >> 16) & 0xff, (value >> 24) & 0xff};
+            buffer_append(&payload, bytes, 4);
+        }
+        for (int i = 0; i < n; i++) {
+            Run *run = state->runs + start + i;
+            char bytes[CHUNK_RUN_SIZE] = {
+                run->dx, run->dz, run->y, run->n, run->w};
+            buffer_append(&payload, bytes, CHUNK_RUN_SIZE);
+        }
+        append_frame(frames, FRAME_CHUNK, payload.data, payload.size);
+    }
+    buffer_free(&payload);
+}
+
+static void encode_chunk(Reader *worker_reader, Result *result) {
+    Job *job = &result->job;
+    ChunkState state = {0};
+    state.p = job->p;
+    state.q = job->q;
+    state.binary = job->binary;
+    state.text = &result->text;
+    int key = store_load_blocks(
+        worker_reader, job->p, job->q, job->key, chunk_block, &state);
+    int blocks = state.blocks;
+    store_load_lights(worker_reader, job->p, job->q, chunk_light, &state);
+    store_load_signs(worker_reader, job->p, job->q, chunk_sign, &state);
+    encode_runs(&state, &result->frames);
+    free(state.runs);
+    if (blocks) {
+        buffer_printf(&result->text, "K,%d,%d,%d\n", job->p, job->q, key);
+    }
+    if (state.blocks) {
+        buffer_printf(&result->text, "R,%d,%d\n", job->p, job->q);
+    }
+}
+
+static int worker_run(void *arg) {
+    Reader worker_reader;
+    if (store_reader_open(&worker_reader)) {
+        fprintf(stderr, "worker: cannot open %s\n", SERVER_DB_PATH);
+        exit(1);
+    }
+    while (1) {
+        mtx_lock(&job_mtx);
+        while (job_count == 0) {
+            cnd_wait(&job_cnd, &job_mtx);
+        }
+        Result *result = calloc(1, sizeof(Result));
+        result->job = jobs[0];
+        memmove(jobs, jobs + 1, sizeof(Job) * --job_count);
+        mtx_unlock(&job_mtx);
+        // edits after this point may be missing from the snapshot and are
+        // replayed by finish_chunk
+        result->job.edit_seq = store_committed();
+        encode_chunk(&worker_reader, result);
+        mtx_lock(&result_mtx);
+        if (result_count == result_capacity) {
+            result_capacity = result_capacity * 2 + 64;
+            results = realloc(results, sizeof(Result *) * result_capacity);
+        }
+        results[result_count++] = result;
+        mtx_unlock(&result_mtx);
+        if (write(wake_pipe[1], "", 1) < 0 && errno != EAGAIN) {
+            perror("write");
+        }
+    }
+    return 0;
+}
+
+static void submit_chunk(Client *client, int p, int q, int key) {
+    Job job;
+    job.slot = client - clients;
+    job.serial = client->serial;
+    job.p = p;
+    job.q = q;
+    job.key = key;
+    job.binary = client->binary;
+    job.edit_seq = 0;
+    mtx_lock(&job_mtx);
+    if (job_count == job_capacity) {
+        job_capacity = job_capacity * 2 + 256;
+        jobs = realloc(jobs, sizeof(Job) * job_capacity);
+    }
+    jobs[job_count++] = job;
+    cnd_signal(&job_cnd);
+    mtx_unlock(&job_mtx);
+}
+
+static void cancel_chunk(Client *client, int p, int q) {
+    // only requests no worker has picked up yet can be dropped
+    int slot = client - clients;
+    mtx_lock(&job_mtx);
+    int count = 0;
+    for (int i = 0; i < job_count; i++) {
+        Job *job = jobs + i;
+        if (job->slot == slot && job->serial == client->serial &&
+            job->p == p && job->q == q)
+        {
+            continue;
+        }
+        jobs[count++] = *job;
+    }
+    job_count = count;
+    mtx_unlock(&job_mtx);
+}
+
+static void finish_chunk(Result *result) {
+    Job *job = &result->job;
+    Client *client = clients + job->slot;
+    if (client->fd < 0 || client->serial != job->serial) {
+        return;
+    }
+    if (job->edit_seq < edit_seq - EDIT_LOG_SIZE) {
+        // edits the snapshot may lack have left the log, read it again
+        submit_chunk(client, job->p, job->q, job->key);
+        return;
+    }
+    flush_text(client);
+    buffer_append(&client->out, result->frames.data, result->frames.size);
+    buffer_append(&client->text, result->text.data, result->text.size);
+    // replay, in order, the edits the store had not committed when the
+    // worker took its snapshot
+    int patched = 0;
+    for (long seq = job->edit_seq + 1; seq <= edit_seq; seq++) {
+        Edit *edit = edits + (seq % EDIT_LOG_SIZE);
+        if (edit->p != job->p || edit->q != job->q) {
+            continue;
+        }
+        if (edit->type == 'S') {
+            send_line(client, "S,%d,%d,%d,%d,%d,%d,%s", edit->p, edit->q,
+                edit->x, edit->y, edit->z, edit->w, edit->text);
+        }
+        else {
+            send_line(client, "%c,%d,%d,%d,%d,%d,%d", edit->type,
+                edit->p, edit->q, edit->x, edit->y, edit->z, edit->w);
+        }
+        patched = 1;
+    }
+    if (patched) {
+        send_line(client, "R,%d,%d", job->p, job->q);
+    }
+    send_line(client, "C,%d,%d", job->p, job->q);
+    stats_chunks++;
+}
+
+static void drain_results() {
+    char data[256];
+    while (read(wake_pipe[0], data, sizeof(data)) > 0);
+    mtx_lock(&result_mtx);
+    Result **batch = results;
+    int count = result_count;
+    results = 0;
+    result_count = result_capacity = 0;
+    mtx_unlock(&result_mtx);
+    for (int i = 0; i < count; i++) {
+        finish_chunk(batch[i]);
+        buffer_free(&batch[i]->frames);
+        buffer_free(&batch[i]->text);
+        free(batch[i]);
+    }
+    free(batch);
+}
+
+// commands //
+
+static Client *find_nick(const char *nick) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0 && strcmp(clients[i].nick, nick) == 0) {
+            return clients + i;
+        }
+    }
+    return 0;
+}
+
+static void teleport(Client *client, float x, float y, float z,
+    float rx, float ry)
+{
+    client->x = x; client->y = y; client->z = z;
+    client->rx = rx; client->ry = ry;
+    send_you(client);
+    send_position(client);
+}
+
+static void on_command(Client *client, const char *text) {
+    char name[MAX_NICK_LENGTH];
+    char line[MAX_LINE_LENGTH];
+    int p, q;
+    if (strcmp(text, "/nick") == 0) {
+        send_line(client, "T,Your nickname is %s", client->nick);
+    }
+    else if (sscanf(text, "/nick %31[^, ]", name) == 1) {
+        snprintf(line, sizeof(line), "%s is now known as %s",
+            client->nick, name);
+        send_talk(line);
+        strncpy(client->nick, name, MAX_NICK_LENGTH);
+        send_nick(client);
+    }
+    else if (strcmp(text, "/spawn") == 0) {
+        teleport(client, 0, 0, 0, 0, 0);
+    }
+    else if (strcmp(text, "/goto") == 0 ||
+        sscanf(text, "/goto %31s", name) == 1)
+    {
+        Client *other = 0;
+        if (strcmp(text, "/goto") == 0) {
+            int count = 0;
+            for (int i = 0; i < MAX_CLIENTS; i++) {
+                Client *c = clients + i;
+                if (c->fd >= 0 && c != client && rand() % ++count == 0) {
+                    other = c;
+                }
+            }
+        }
+        else {
+            other = find_nick(name);
+        }
+        if (other) {
+            teleport(client, other->x, other->y, other->z,
+                other->rx, other->ry);
+        }
+    }
+    else if (sscanf(text, "/pq %d%*[ ,]%d", &p, &q) == 2) {
+        if (ABS(p) <= 1000 && ABS(q) <= 1000) {
+            teleport(client, p * CHUNK_SIZE, 0, q * CHUNK_SIZE, 0, 0);
+        }
+    }
+    else if (strncmp(text, "/help", 5) == 0) {
+        send_line(client, "T,Type \"t\" to chat. Type \"/\" to type commands:");
+        send_line(client, "T,/goto [NAME], /help [TOPIC], /list, "
+            "/login NAME, /logout, /nick");
+        send_line(client, "T,/offline [FILE], /online HOST [PORT], "
+            "/pq P Q, /spawn, /view N");
+    }
+    else if (strcmp(text, "/list") == 0) {
+        int length = snprintf(line, sizeof(line), "T,Players: ");
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 && length < (int)sizeof(line)) {
+                length += snprintf(line + length, sizeof(line) - length,
+                    "%s%s", length > 11 ? ", " : "", clients[i].nick);
+            }
+        }
+        send_line(client, "%s", line);
+    }
+    else {
+        send_line(client, "T,Unrecognized command: \"%s\"", text);
+    }
+}
+
+static void on_talk(Client *client, const char *text) {
+    char line[MAX_LINE_LENGTH];
+    if (text[0] == '/') {
+        on_command(client, text);
+    }
+    else if (text[0] == '@') {
+        char nick[MAX_NICK_LENGTH];
+        sscanf(text + 1, "%31[^ ]", nick);
+        Client *other = find_nick(nick);
+        if (other) {
+            send_line(client, "T,%s> %s", client->nick, text);
+            send_line(other, "T,%s> %s", client->nick, text);
+        }
+        else {
+            send_line(client, "T,Unrecognized nick: \"%s\"", nick);
+        }
+    }
+    else {
+        // the nick and separator always fit, long messages are cut
+        snprintf(line, sizeof(line), "%s> %.*s", client->nick,
+            MAX_LINE_LENGTH - MAX_NICK_LENGTH - 2, text);
+        send_talk(line);
+    }
+}
+
+static void reject_block(Client *client, int p, int q, int x, int y, int z,
+    int previous, const char *message)
+{
+    send_line(client, "B,%d,%d,%d,%d,%d,%d", p, q, x, y, z, previous);
+    send_line(client, "R,%d,%d", p, q);
+    send_line(client, "T,%s", message);
+}
+
+static void on_block(Client *client, int x, int y, int z, int w) {
+    int p = chunked(x);
+    int q = chunked(z);
+    int previous = get_block(x, y, z);
+    const char *message = 0;
+    if (y <= 0 || y > 255) {
+        message = "Invalid block coordinates.";
+    }
+    else if (w < 0 || w > 63 || w == 16 || (w > 23 && w < 32)) {
+        message = "That item is not allowed.";
+    }
+    else if (w && previous) {
+        message = "Cannot create blocks in a non-empty space.";
+    }
+    else if (!w && !previous) {
+        message = "That space is already empty.";
+    }
+    else if (previous == 16) {
+        message = "Cannot destroy that type of block.";
+    }
+    if (message) {
+        reject_block(client, p, q, x, y, z, previous, message);
+        return;
+    }
+    store_set_block(p, q, x, y, z, w);
+    if (w == 0) {
+        store_clear_block(x, y, z);
+    }
+    log_edit('B', p, q, x, y, z, w, NULL);
+    send_others(client, "B,%d,%d,%d,%d,%d,%d\nR,%d,%d",
+        p, q, x, y, z, w, p, q);
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            if (dx == 0 && dz == 0) {
+                continue;
+            }
+            if (dx && chunked(x + dx) == p) {
+                continue;
+            }
+            if (dz && chunked(z + dz) == q) {
+                continue;
+            }
+            int np = p + dx;
+            int nq = q + dz;
+            store_set_block(np, nq, x, y, z, -w);
+            log_edit('B', np, nq, x, y, z, -w, NULL);
+            send_others(client, "B,%d,%d,%d,%d,%d,%d\nR,%d,%d",
+                np, nq, x, y, z, -w, np, nq);
+        }
+    }
+}
+
+static void on_light(Client *client, int x, int y, int z, int w) {
+    int p = chunked(x);
+    int q = chunked(z);
+    const char *message = 0;
+    if (get_block(x, y, z) == 0) {
+        message = "Lights must be placed on a block.";
+    }
+    else if (w < 0 || w > 15) {
+        message = "Invalid light value.";
+    }
+    if (message) {
+        send_line(client, "R,%d,%d", p, q);
+        send_line(client, "T,%s", message);
+        return;
+    }
+    store_set_light(p, q, x, y, z, w);
+    log_edit('L', p, q, x, y, z, w, NULL);
+    send_others(client, "L,%d,%d,%d,%d,%d,%d\nR,%d,%d",
+        p, q, x, y, z, w, p, q);
+}
+
+static void on_sign(Client *client, int x, int y, int z, int face,
+    const char *text)
+{
+    if (y <= 0 || y > 255 || face < 0 || face > 7) {
+        return;
+    }
+    if (strlen(text) > MAX_SIGN_TEXT) {
+        return;
+    }
+    int p = chunked(x);
+    int q = chunked(z);
+    store_set_sign(p, q, x, y, z, face, text);
+    log_edit('S', p, q, x, y, z, face, text);
+    send_others(client, "S,%d,%d,%d,%d,%d,%d,%s", p, q, x, y, z, face, text);
+}
+
+static void on_line(Client *client, char *line) {
+    int x, y, z, w, face, offset;
+    float px, py, pz, prx, pry;
+    char name[MAX_NICK_LENGTH];
+    switch (line[0]) {
+        case 'V':
+            if (client->version || sscanf(line, "V,%d", &w) != 1) {
+                return;
+            }
+            if (w != PROTOCOL_TEXT && w != PROTOCOL_BINARY) {
+                shutdown(client->fd, SHUT_RDWR);
+                return;
+            }
+            client->version = w;
+            if (w > PROTOCOL_TEXT) {
+                // everything after the ack is framed
+                send_line(client, "V,%d", w);
+                flush_text(client);
+                client->binary = 1;
+            }
+            break;
+        case 'A':
+            if (sscanf(line, "A,%31[^,]", name) == 1) {
+                strncpy(client->nick, name, MAX_NICK_LENGTH);
+            }
+            send_nick(client);
+            snprintf(line, MAX_LINE_LENGTH, "%s has joined the game.",
+                client->nick);
+            send_talk(line);
+            break;
+        case 'C':
+            w = 0;
+            if (sscanf(line, "C,%d,%d,%d", &x, &z, &w) >= 2) {
+                submit_chunk(client, x, z, w);
+            }
+            break;
+        case 'X':
+            if (sscanf(line, "X,%d,%d", &x, &z) == 2) {
+                cancel_chunk(client, x, z);
+            }
+            break;
+        case 'B':
+            if (sscanf(line, "B,%d,%d,%d,%d", &x, &y, &z, &w) == 4) {
+                on_block(client, x, y, z, w);
+            }
+            break;
+        case 'L':
+            if (sscanf(line, "L,%d,%d,%d,%d", &x, &y, &z, &w) == 4) {
+                on_light(client, x, y, z, w);
+            }
+            break;
+        case 'S':
+            offset = 0;
+            if (sscanf(line, "S,%d,%d,%d,%d,%n",
+                &x, &y, &z, &face, &offset) == 4 && offset)
+            {
+                on_sign(client, x, y, z, face, line + offset);
+            }
+            break;
+        case 'P':
+            if (sscanf(line, "P,%f,%f,%f,%f,%f",
+                &px, &py, &pz, &prx, &pry) == 5)
+            {
+                client->x = px; client->y = py; client->z = pz;
+                client->rx = prx; client->ry = pry;
+                send_position(client);
+            }
+            break;
+        case 'T':
+            if (line[1] == ',') {
+                on_talk(client, line + 2);
+            }
+            break;
+    }
+}
+
+// connections //
+
+static void on_connect(int fd, struct sockaddr_in *address) {
+    Client *client = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].fd < 0) {
+            client = clients + i;
+            break;
+        }
+    }
+    if (!client) {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    client->fd = fd;
+    client->id = client - clients + 1;
+    client->serial++;
+    client->version = 0;
+    client->binary = 0;
+    client->x = client->y = client->z = client->rx = client->ry = 0;
+    snprintf(client->nick, MAX_NICK_LENGTH, "guest%d", client->id);
+    client_count++;
+    printf("CONN %d %s %d\n", client->id,
+        inet_ntoa(address->sin_addr), ntohs(address->sin_port));
+    send_you(client);
+    send_line(client, "E,%.2f,%d", (double)time(NULL), DAY_LENGTH);
+    send_line(client, "T,Welcome to Craft!");
+    send_line(client, "T,Type \"/help\" for a list of commands.");
+    send_position(client);
+    send_positions(client);
+    send_nick(client);
+    send_nicks(client);
+}
+
+static void on_disconnect(Client *client) {
+    char line[MAX_LINE_LENGTH];
+    printf("DISC %d\n", client->id);
+    close(client->fd);
+    client->fd = -1;
+    client->serial++;
+    buffer_free(&client->in);
+    buffer_free(&client->text);
+    buffer_free(&client->out);
+    client_count--;
+    send_others(client, "D,%d", client->id);
+    snprintf(line, sizeof(line), "%s has disconnected from the server.",
+        client->nick);
+    send_talk(line);
+}
+
+static int on_readable(Client *client) {
+    char data[RECV_SIZE];
+    int length = recv(client->fd, data, sizeof(data), 0);
+    if (length == 0 || (length < 0 && errno != EAGAIN)) {
+        return -1;
+    }
+    if (length < 0) {
+        return 0;
+    }
+    buffer_append(&client->in, data, length);
+    Buffer *in = &client->in;
+    int start = 0;
+    for (int i = 0; i < in->size; i++) {
+        if (in->data[i] != '\n') {
+            continue;
+        }
+        char line[MAX_LINE_LENGTH];
+        int n = i - start;
+        if (n && in->data[start + n - 1] == '\r') {
+            n--;
+        }
+        if (n > 0 && n < MAX_LINE_LENGTH) {
+            memcpy(line, in->data + start, n);
+            line[n] = '\0';
+            on_line(client, line);
+            if (client->fd < 0) {
+                return 0;
+            }
+        }
+        start = i + 1;
+    }
+    buffer_consume(in, start);
+    if (in->size > MAX_LINE_LENGTH * 16) {
+        return -1;
+    }
+    return 0;
+}
+
+static int on_writable(Client *client) {
+    Buffer *out = &client->out;
+    int sent = 0;
+    while (sent < out->size) {
+        int n = send(client->fd, out->data + sent, out->size - sent,
+            MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                break;
+            }
+            return -1;
+        }
+        sent += n;
+    }
+    stats_bytes += sent;
+    buffer_consume(out, sent);
+    return out->size > MAX_OUT_SIZE ? -1 : 0;
+}
+
+static void on_signal(int sig) {
+    running = 0;
+}
+
+static int listen_socket(const char *host, int port) {
+    struct sockaddr_in address;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(host);
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(fd, 128) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    const char *host = DEFAULT_HOST;
+    const char *db_path = SERVER_DB_PATH;
+    int port = DEFAULT_PORT;
+    int workers = DEFAULT_WORKERS;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-db") == 0 && i + 1 < argc) {
+            db_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        }
+        else if (positional++ == 0) {
+            host = argv[i];
+        }
+        else {
+            port = atoi(argv[i]);
+        }
+    }
+    if (store_open(db_path) || store_reader_open(&reader)) {
+        fprintf(stderr, "cannot open %s\n", db_path);
+        return 1;
+    }
+    int listener = listen_socket(host, port);
+    if (listener < 0) {
+        perror("listen");
+        return 1;
+    }
+    if (pipe(wake_pipe) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    mtx_init(&job_mtx, mtx_plain);
+    cnd_init(&job_cnd);
+    mtx_init(&result_mtx, mtx_plain);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+    for (int i = 0; i < workers; i++) {
+        thrd_t thrd;
+        thrd_create(&thrd, worker_run, NULL);
+    }
+    printf("SERV %s %d (%d workers)\n", host, port, workers);
+    static struct pollfd fds[MAX_CLIENTS + 2];
+    static int slots[MAX_CLIENTS + 2];
+    time_t last_stats = time(NULL);
+    while (running) {
+        int count = 0;
+        fds[count].fd = listener;
+        fds[count++].events = POLLIN;
+        fds[count].fd = wake_pipe[0];
+        fds[count++].events = POLLIN;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            Client *client = clients + i;
+            if (client->fd < 0) {
+                continue;
+            }
+            slots[count] = i;
+            fds[count].fd = client->fd;
+            fds[count].events = POLLIN | (client->out.size ? POLLOUT : 0);
+            fds[count++].revents = 0;
+        }
+        if (poll(fds, count, 1000) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            drain_results();
+        }
+        if (fds[0].revents & POLLIN) {
+            struct sockaddr_in address;
+            socklen_t length = sizeof(address);
+            int fd;
+            while ((fd = accept(listener,
+                (struct sockaddr *)&address, &length)) >= 0)
+            {
+                on_connect(fd, &address);
+            }
+        }
+        for (int i = 2; i < count; i++) {
+            Client *client = clients + slots[i];
+            if (client->fd != fds[i].fd || !fds[i].revents) {
+                continue;
+            }
+            if (on_readable(client) < 0) {
+                on_disconnect(client);
+            }
+        }
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            Client *client = clients + i;
+            if (client->fd < 0) {
+                continue;
+            }
+            flush_text(client);
+            if (client->out.size && on_writable(client) < 0) {
+                on_disconnect(client);
+            }
+        }
+        time_t now = time(NULL);
+        if (now - last_stats >= STATS_INTERVAL) {
+            printf("STAT clients=%d chunks/s=%.1f KB/s=%.1f pending=%d\n",
+                client_count, (double)stats_chunks / (now - last_stats),
+                stats_bytes / 1024.0 / (now - last_stats), store_pending());
+            stats_chunks = stats_bytes = 0;
+            last_stats = now;
+        }
+    }
+    printf("SHUTDOWN\n");
+    store_close();
+    return 0;
+}
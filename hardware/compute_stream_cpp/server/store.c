@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "store.h"
+#include "tinycthread.h"
+
+#define OP_BLOCK 0
+#define OP_LIGHT 1
+#define OP_SIGN 2
+#define OP_CLEAR 3
+#define OP_MARK 4
+
+typedef struct {
+    int type;
+    int p;
+    int q;
+    int x;
+    int y;
+    int z;
+    int w;
+    long seq;
+    char text[MAX_STORE_TEXT];
+} Op;
+
+typedef struct {
+    Op *data;
+    int size;
+    int capacity;
+} OpList;
+
+static char store_path[256];
+static sqlite3 *db;
+static sqlite3_stmt *insert_block_stmt;
+static sqlite3_stmt *insert_light_stmt;
+static sqlite3_stmt *insert_sign_stmt;
+static sqlite3_stmt *delete_sign_stmt;
+static sqlite3_stmt *delete_signs_stmt;
+static sqlite3_stmt *clear_lights_stmt;
+
+// writes are queued by the event loop and applied by a single thread that
+// wraps everything queued since its last pass in one transaction
+static OpList queue;
+static OpList batch;
+static int running;
+static long committed;
+static thrd_t thrd;
+static mtx_t mtx;
+static cnd_t cnd;
+
+static int store_worker(void *arg);
+
+static int open_database(sqlite3 **result) {
+    int rc = sqlite3_open(store_path, result);
+    if (rc) return rc;
+    sqlite3_busy_timeout(*result, 5000);
+    return sqlite3_exec(*result,
+        "pragma journal_mode = wal;"
+        "pragma synchronous = normal;", NULL, NULL, NULL);
+}
+
+int store_open(const char *path) {
+    static const char *create_query =
+        "create table if not exists block ("
+        "    p int not null,"
+        "    q int not null,"
+        "    x int not null,"
+        "    y int not null,"
+        "    z int not null,"
+        "    w int not null"
+        ");"
+        "create unique index if not exists block_pqxyz_idx on "
+        "    block (p, q, x, y, z);"
+        "create table if not exists light ("
+        "    p int not null,"
+        "    q int not null,"
+        "    x int not null,"
+        "    y int not null,"
+        "    z int not null,"
+        "    w int not null"
+        ");"
+        "create unique index if not exists light_pqxyz_idx on "
+        "    light (p, q, x, y, z);"
+        "create table if not exists sign ("
+        "    p int not null,"
+        "    q int not null,"
+        "    x int not null,"
+        "    y int not null,"
+        "    z int not null,"
+        "    face int not null,"
+        "    text text not null"
+        ");"
+        "create index if not exists sign_pq_idx on sign (p, q);"
+        "create unique index if not exists sign_xyzface_idx on "
+        "    sign (x, y, z, face);"
+        "create table if not exists block_history ("
+        "   timestamp real not null,"
+        "   user_id int not null,"
+        "   x int not null,"
+        "   y int not null,"
+        "   z int not null,"
+        "   w int not null"
+        ");";
+    static const char *insert_block_query =
+        "insert or replace into block (p, q, x, y, z, w) "
+        "values (?, ?, ?, ?, ?, ?);";
+    static const char *insert_light_query =
+        "insert or replace into light (p, q, x, y, z, w) "
+        "values (?, ?, ?, ?, ?, ?);";
+    static const char *insert_sign_query =
+        "insert or replace into sign (p, q, x, y, z, face, text) "
+        "values (?, ?, ?, ?, ?, ?, ?);";
+    static const char *delete_sign_query =
+        "delete from sign where x = ? and y = ? and z = ? and face = ?;";
+    static const char *delete_signs_query =
+        "delete from sign where x = ? and y = ? and z = ?;";
+    static const char *clear_lights_query =
+        "update light set w = 0 where x = ? and y = ? and z = ?;";
+    int rc;
+    strncpy(store_path, path, sizeof(store_path) - 1);
+    rc = open_database(&db);
+    if (rc) return rc;
+    rc = sqlite3_exec(db, create_query, NULL, NULL, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, insert_block_query, -1, &insert_block_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, insert_light_query, -1, &insert_light_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, insert_sign_query, -1, &insert_sign_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, delete_sign_query, -1, &delete_sign_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, delete_signs_query, -1, &delete_signs_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, clear_lights_query, -1, &clear_lights_stmt, NULL);
+    if (rc) return rc;
+    running = 1;
+    mtx_init(&mtx, mtx_plain);
+    cnd_init(&cnd);
+    thrd_create(&thrd, store_worker, NULL);
+    return 0;
+}
+
+void store_close() {
+    mtx_lock(&mtx);
+    running = 0;
+    cnd_signal(&cnd);
+    mtx_unlock(&mtx);
+    thrd_join(thrd, NULL);
+    cnd_destroy(&cnd);
+    mtx_destroy(&mtx);
+    sqlite3_finalize(insert_block_stmt);
+    sqlite3_finalize(insert_light_stmt);
+    sqlite3_finalize(insert_sign_stmt);
+    sqlite3_finalize(delete_sign_stmt);
+    sqlite3_finalize(delete_signs_stmt);
+    sqlite3_finalize(clear_lights_stmt);
+    sqlite3_close(db);
+    free(queue.data);
+    free(batch.data);
+}
+
+int store_reader_open(Reader *reader) {
+    static const char *get_block_query =
+        "select w from block where "
+        "p = ? and q = ? and x = ? and y = ? and z = ?;";
+    static const char *load_blocks_query =
+        "select rowid, x, y, z, w from block where "
+        "p = ? and q = ? and rowid > ?;";
+    static const char *load_lights_query =
+        "select x, y, z, w from light where p = ? and q = ?;";
+    static const char *load_signs_query =
+        "select x, y, z, face, text from sign where p = ? and q = ?;";
+    int rc;
+    rc = open_database(&reader->db);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        reader->db, get_block_query, -1, &reader->get_block, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        reader->db, load_blocks_query, -1, &reader->load_blocks, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        reader->db, load_lights_query, -1, &reader->load_lights, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        reader->db, load_signs_query, -1, &reader->load_signs, NULL);
+    if (rc) return rc;
+    return 0;
+}
+
+void store_reader_close(Reader *reader) {
+    sqlite3_finalize(reader->get_block);
+    sqlite3_finalize(reader->load_blocks);
+    sqlite3_finalize(reader->load_lights);
+    sqlite3_finalize(reader->load_signs);
+    sqlite3_close(reader->db);
+}
+
+static int chunked(int x) {
+    return x >= 0 ? x / 32 : -((-x + 31) / 32);
+}
+
+int store_get_block(Reader *reader, int x, int y, int z, int *w) {
+    sqlite3_stmt *stmt = reader->get_block;
+    int result = 0;
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 1, chunked(x));
+    sqlite3_bind_int(stmt, 2, chunked(z));
+    sqlite3_bind_int(stmt, 3, x);
+    sqlite3_bind_int(stmt, 4, y);
+    sqlite3_bind_int(stmt, 5, z);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        *w = sqlite3_column_int(stmt, 0);
+        result = 1;
+    }
+    return result;
+}
+
+int store_load_blocks(
+    Reader *reader, int p, int q, int key, block_func func, void *arg)
+{
+    sqlite3_stmt *stmt = reader->load_blocks;
+    int result = 0;
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 1, p);
+    sqlite3_bind_int(stmt, 2, q);
+    sqlite3_bind_int(stmt, 3, key);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int rowid = sqlite3_column_int(stmt, 0);
+        int x = sqlite3_column_int(stmt, 1);
+        int y = sqlite3_column_int(stmt, 2);
+        int z = sqlite3_column_int(stmt, 3);
+        int w = sqlite3_column_int(stmt, 4);
+        func(x, y, z, w, arg);
+        result = rowid > result ? rowid : result;
+    }
+    return result;
+}
+
+void store_load_lights(
+    Reader *reader, int p, int q, block_func func, void *arg)
+{
+    sqlite3_stmt *stmt = reader->load_lights;
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 1, p);
+    sqlite3_bind_int(stmt, 2, q);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int x = sqlite3_column_int(stmt, 0);
+        int y = sqlite3_column_int(stmt, 1);
+        int z = sqlite3_column_int(stmt, 2);
+        int w = sqlite3_column_int(stmt, 3);
+        func(x, y, z, w, arg);
+    }
+}
+
+void store_load_signs(Reader *reader, int p, int q, sign_func func, void *arg) {
+    sqlite3_stmt *stmt = reader->load_signs;
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 1, p);
+    sqlite3_bind_int(stmt, 2, q);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int x = sqlite3_column_int(stmt, 0);
+        int y = sqlite3_column_int(stmt, 1);
+        int z = sqlite3_column_int(stmt, 2);
+        int face = sqlite3_column_int(stmt, 3);
+        const char *text = (const char *)sqlite3_column_text(stmt, 4);
+        func(x, y, z, face, text, arg);
+    }
+}
+
+static void put(int type, int p, int q, int x, int y, int z, int w,
+    const char *text, long seq)
+{
+    mtx_lock(&mtx);
+    if (queue.size == queue.capacity) {
+        queue.capacity = queue.capacity ? queue.capacity * 2 : 1024;
+        queue.data = realloc(queue.data, sizeof(Op) * queue.capacity);
+    }
+    Op *op = queue.data + queue.size++;
+    op->type = type;
+    op->p = p; op->q = q; op->x = x; op->y = y; op->z = z; op->w = w;
+    op->seq = seq;
+    op->text[0] = '\0';
+    if (text) {
+        strncpy(op->text, text, MAX_STORE_TEXT - 1);
+        op->text[MAX_STORE_TEXT - 1] = '\0';
+    }
+    cnd_signal(&cnd);
+    mtx_unlock(&mtx);
+}
+
+void store_set_block(int p, int q, int x, int y, int z, int w) {
+    put(OP_BLOCK, p, q, x, y, z, w, NULL, 0);
+}
+
+void store_set_light(int p, int q, int x, int y, int z, int w) {
+    put(OP_LIGHT, p, q, x, y, z, w, NULL, 0);
+}
+
+void store_set_sign(
+    int p, int q, int x, int y, int z, int face, const char *text)
+{
+    put(OP_SIGN, p, q, x, y, z, face, text, 0);
+}
+
+void store_clear_block(int x, int y, int z) {
+    put(OP_CLEAR, 0, 0, x, y, z, 0, NULL, 0);
+}
+
+void store_mark(long seq) {
+    // everything queued before the mark is committed once store_committed
+    // reaches seq
+    put(OP_MARK, 0, 0, 0, 0, 0, 0, NULL, seq);
+}
+
+long store_committed() {
+    mtx_lock(&mtx);
+    long result = committed;
+    mtx_unlock(&mtx);
+    return result;
+}
+
+int store_pending() {
+    mtx_lock(&mtx);
+    int result = queue.size;
+    mtx_unlock(&mtx);
+    return result;
+}
+
+static void bind_block(sqlite3_stmt *stmt, Op *op) {
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 1, op->p);
+    sqlite3_bind_int(stmt, 2, op->q);
+    sqlite3_bind_int(stmt, 3, op->x);
+    sqlite3_bind_int(stmt, 4, op->y);
+    sqlite3_bind_int(stmt, 5, op->z);
+    sqlite3_bind_int(stmt, 6, op->w);
+}
+
+static void apply(Op *op) {
+    sqlite3_stmt *stmt;
+    switch (op->type) {
+        case OP_BLOCK:
+            bind_block(insert_block_stmt, op);
+            sqlite3_step(insert_block_stmt);
+            break;
+        case OP_LIGHT:
+            bind_block(insert_light_stmt, op);
+            sqlite3_step(insert_light_stmt);
+            break;
+        case OP_SIGN:
+            if (op->text[0]) {
+                stmt = insert_sign_stmt;
+                bind_block(stmt, op);
+                sqlite3_bind_text(stmt, 7, op->text, -1, NULL);
+            }
+            else {
+                stmt = delete_sign_stmt;
+                sqlite3_reset(stmt);
+                sqlite3_bind_int(stmt, 1, op->x);
+                sqlite3_bind_int(stmt, 2, op->y);
+                sqlite3_bind_int(stmt, 3, op->z);
+                sqlite3_bind_int(stmt, 4, op->w);
+            }
+            sqlite3_step(stmt);
+            break;
+        case OP_CLEAR:
+            stmt = delete_signs_stmt;
+            sqlite3_reset(stmt);
+            sqlite3_bind_int(stmt, 1, op->x);
+            sqlite3_bind_int(stmt, 2, op->y);
+            sqlite3_bind_int(stmt, 3, op->z);
+            sqlite3_step(stmt);
+            stmt = clear_lights_stmt;
+            sqlite3_reset(stmt);
+            sqlite3_bind_int(stmt, 1, op->x);
+            sqlite3_bind_int(stmt, 2, op->y);
+            sqlite3_bind_int(stmt, 3, op->z);
+            sqlite3_step(stmt);
+            break;
+    }
+}
+
+static int store_worker(void *arg) {
+    while (1) {
+        mtx_lock(&mtx);
+        while (running && queue.size == 0) {
+            cnd_wait(&cnd, &mtx);
+        }
+        if (!running && queue.size == 0) {
+            mtx_unlock(&mtx);
+            break;
+        }
+        OpList swap = batch;
+        batch = queue;
+        queue = swap;
+        queue.size = 0;
+        mtx_unlock(&mtx);
+        long seq = 0;
+        sqlite3_exec(db, "begin;", NULL, NULL, NULL);
+        for (int i = 0; i < batch.size; i++) {
+            Op *op = batch.data + i;
+            apply(op);
+            seq = op->type == OP_MARK ? op->seq : seq;
+        }
+        if (sqlite3_exec(db, "commit;", NULL, NULL, NULL)) {
+            fprintf(stderr, "store: %s\n", sqlite3_errmsg(db));
+        }
+        else if (seq) {
+            mtx_lock(&mtx);
+            committed = seq;
+            mtx_unlock(&mtx);
+        }
+        batch.size = 0;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef _store_h_
+#define _store_h_
+
+#include "sqlite3.h"
+
+#define MAX_STORE_TEXT 64
+
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *get_block;
+    sqlite3_stmt *load_blocks;
+    sqlite3_stmt *load_lights;
+    sqlite3_stmt *load_signs;
+} Reader;
+
+typedef void (*block_func)(int x, int y, int z, int w, void *arg);
+typedef void (*sign_func)(
+    int x, int y, int z, int face, const char *text, void *arg);
+
+int store_open(const char *path);
+void store_close();
+int store_reader_open(Reader *reader);
+void store_reader_close(Reader *reader);
+int store_get_block(Reader *reader, int x, int y, int z, int *w);
+int store_load_blocks(
+    Reader *reader, int p, int q, int key, block_func func, void *arg);
+void store_load_lights(
+    Reader *reader, int p, int q, block_func func, void *arg);
+void store_load_signs(Reader *reader, int p, int q, sign_func func, void *arg);
+void store_set_block(int p, int q, int x, int y, int z, int w);
+void store_set_light(int p, int q, int x, int y, int z, int w);
+void store_set_sign(
+    int p, int q, int x, int y, int z, int face, const char *text);
+void store_clear_block(int x, int y, int z);
+void store_mark(long seq);
+long store_committed();
+int store_pending();
+
+#endif
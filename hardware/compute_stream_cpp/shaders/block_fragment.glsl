@@ -12,9 +12,14 @@ varying float fragment_light;
 varying float fog_factor;
 varying float fog_height;
 varying float diffuse;
+varying float eye_distance;
 
 const float pi = 3.14159265;
 
+// working range of the focal stack, nearer and farther depths are clipped
+const float near = 4.0;
+const float far = 64.0;
+
 void main() {
     vec3 color = vec3(texture2D(sampler, fragment_uv));
     if (color == vec3(1.0, 0.0, 1.0)) {
@@ -35,5 +40,9 @@ void main() {
     color = clamp(color * light * ao, vec3(0.0), vec3(1.0));
     vec3 sky_color = vec3(texture2D(sky_sampler, vec2(timer, fog_height)));
     color = mix(color, sky_color, fog_factor);
-    gl_FragColor = vec4(color, 1.0);
+    gl_FragData[0] = vec4(color, 1.0);
+    // diopters mapped to [0, 1], 0 at the far end of the range
+    float diopter = 1.0 / clamp(eye_distance, near, far);
+    diopter = (diopter - 1.0 / far) / (1.0 / near - 1.0 / far);
+    gl_FragData[1] = vec4(diopter, 0.0, 0.0, 1.0);
 }
@@ -1,11 +1,19 @@
 #version 120
 
 uniform sampler2D sampler;
+uniform sampler2D remap_sampler;
 uniform bool is_sign;
 
 varying vec2 fragment_uv;
 
 void main() {
-    vec4 color = texture2D(sampler, fragment_uv);
+    // the remap table is stored bottom row first and holds the position
+    // in the slm image seen at this oled pixel
+    vec2 uv = texture2D(remap_sampler,
+        vec2(fragment_uv.x, 1.0 - fragment_uv.y)).rg;
+    if (uv.x < 0.0) {
+        discard;
+    }
+    vec4 color = texture2D(sampler, uv);
     gl_FragColor = vec4(color);
 }
@@ -5,9 +5,6 @@ uniform int mode;
 
 varying vec2 fragment_uv;
 
-float near = 0.125;
-float far  = 64.0;
-
 float nominal_a = -1.966041;
 float fX = -0.0126;
 float fY = 0.0001;
@@ -22,27 +19,11 @@ float slmWidth = 4000;
 float slmHeight = 2464;
 
 void main() {
-    vec4 depth = texture2D(sampler, fragment_uv);
-
-    if (mode == 0) { // Minecraft mode
-        vec4 ndc = depth * 2.0 - 1.0;
-        depth = (2.0 * near * far) / (far + near - ndc * (far - near));
-
-        near = 4;
-        far = 64;
-
-        // Clip depths
-        depth = max(depth,near);
-        depth = min(depth,far);
-
-        depth = 1 / depth;
-
-        // Map to [0, 1]
-        depth = depth - 1.0 / far;
-        depth = depth / (1.0 / near - 1.0 / far);
-    }
+    // normalized diopters, written by the block shader in minecraft mode
+    // and stored in the depth frames of a video
+    float depth = texture2D(sampler, fragment_uv).r;
 
-    vec4 diopterMap = floor(depth * 50) / 50.0;
+    float diopterMap = floor(depth * 50) / 50.0;
 
     diopterMap = diopterMap * W;
 
@@ -50,17 +31,17 @@ void main() {
     float v = slmHeight * (fragment_uv.y - 0.5);
 
     float factorY = nominal_a / sqrt(1 + nominal_a * nominal_a);
-    vec4 scaleY = ((C0*SLMpitch*fe*fe) / (3*lbda*f0*f0*f0)) * (W / 2 - diopterMap);
-    vec4 scaleX = scaleY / nominal_a;
-    vec4 DeltaX = -scaleX * ((lbda * f0) / (2 * SLMpitch));
-    vec4 DeltaY = -scaleY * ((lbda * f0) / (2 * SLMpitch));
+    float scaleY = ((C0*SLMpitch*fe*fe) / (3*lbda*f0*f0*f0)) * (W / 2 - diopterMap);
+    float scaleX = scaleY / nominal_a;
+    float DeltaX = -scaleX * ((lbda * f0) / (2 * SLMpitch));
+    float DeltaY = -scaleY * ((lbda * f0) / (2 * SLMpitch));
     float N = (lbda * f0) / SLMpitch;
 
-    vec4 thetaX = DeltaX / N;
-    vec4 thetaY = DeltaY / N;
-    vec4 phaseData = mod((thetaX * u + thetaY * v)+((fX * u + fY * v)), 1);
+    float thetaX = DeltaX / N;
+    float thetaY = DeltaY / N;
+    float phaseData = mod((thetaX * u + thetaY * v)+((fX * u + fY * v)), 1);
 
-    gl_FragColor = vec4(phaseData);
+    gl_FragColor = vec4(vec3(phaseData), 1.0);
     gl_FragColor.a = 1;
 
     //gl_FragColor = depth;
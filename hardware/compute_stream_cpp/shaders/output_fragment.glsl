@@ -0,0 +1,67 @@
+#version 120
+
+// produces both display outputs in one pass over a target large enough
+// for either: the slm phase mask in the lower 4000x2464 pixels and the
+// warped oled image in the left 2560x2560 pixels, the phase term is
+// skipped when the cpu provides the mask
+
+uniform sampler2D sampler;
+uniform sampler2D depth_sampler;
+uniform sampler2D remap_sampler;
+uniform bool cpu_phase;
+
+float nominal_a = -1.966041;
+float fX = -0.0126;
+float fY = 0.0001;
+float C0 = 0.0193;
+float lbda = 530e-09;
+float f0 = 100e-03;
+float fe = 40e-03;
+float SLMpitch = 3.74e-06;
+float W = 4.0;
+
+float slmWidth = 4000;
+float slmHeight = 2464;
+float oledSize = 2560;
+
+float phase(vec2 uv) {
+    float depth = texture2D(depth_sampler, uv).r;
+
+    float diopterMap = floor(depth * 50) / 50.0;
+
+    diopterMap = diopterMap * W;
+
+    float u = slmWidth * (uv.x - 0.5);
+    float v = slmHeight * (uv.y - 0.5);
+
+    float scaleY = ((C0*SLMpitch*fe*fe) / (3*lbda*f0*f0*f0)) * (W / 2 - diopterMap);
+    float scaleX = scaleY / nominal_a;
+    float DeltaX = -scaleX * ((lbda * f0) / (2 * SLMpitch));
+    float DeltaY = -scaleY * ((lbda * f0) / (2 * SLMpitch));
+    float N = (lbda * f0) / SLMpitch;
+
+    float thetaX = DeltaX / N;
+    float thetaY = DeltaY / N;
+    return mod((thetaX * u + thetaY * v)+((fX * u + fY * v)), 1);
+}
+
+void main() {
+    vec2 pixel = gl_FragCoord.xy;
+
+    float phaseData = 0.0;
+    if (!cpu_phase && pixel.y < slmHeight) {
+        // same sampling as the full screen pass over the slm window
+        phaseData = phase(vec2(pixel.x / slmWidth, 1 - pixel.y / slmHeight));
+    }
+
+    vec3 color = vec3(0.0);
+    if (pixel.x < oledSize) {
+        vec2 uv = texture2D(remap_sampler, pixel / oledSize).rg;
+        if (uv.x >= 0.0) {
+            color = vec3(texture2D(sampler, uv));
+        }
+    }
+
+    gl_FragData[0] = vec4(vec3(phaseData), 1.0);
+    gl_FragData[1] = vec4(color, 1.0);
+}
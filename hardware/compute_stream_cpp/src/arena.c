@@ -0,0 +1,364 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "config.h"
+
+#define COMPONENTS 10
+#define VERTEX_SIZE (sizeof(GLfloat) * COMPONENTS)
+#define PAGE_VERTICES ((int)(ARENA_PAGE_SIZE / VERTEX_SIZE))
+
+// blocks are rounded up to whole groups of faces to limit fragmentation
+#define GRANULE (6 * 64)
+
+// released ranges are only reused after this many frames, so an upload
+// never overwrites vertices a queued draw may still read
+#define RETIRE_FRAMES 3
+
+typedef struct {
+    int first;
+    int size;
+} Span;
+
+typedef struct {
+    int page;
+    int first;
+    int size;
+    int frame;
+} Retired;
+
+// layout defined by ARB_multi_draw_indirect
+typedef struct {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first;
+    GLuint base_instance;
+} Command;
+
+typedef struct {
+    GLuint buffer;
+    GLuint vao;
+    int size;
+    int span_count;
+    int span_capacity;
+    Span *spans;
+    int command_count;
+    int command_capacity;
+    Command *commands;
+} Page;
+
+static GLuint attribs[3];
+static int use_vao;
+static int use_indirect;
+static GLuint indirect_buffer;
+static Page *pages;
+static int page_count;
+static int page_capacity;
+static Command *batch;
+static GLint *firsts;
+static GLsizei *counts;
+static int batch_capacity;
+static Retired *retired;
+static int retired_count;
+static int retired_capacity;
+static int frame;
+
+void arena_init(GLuint position, GLuint normal, GLuint uv) {
+    attribs[0] = position;
+    attribs[1] = normal;
+    attribs[2] = uv;
+    use_vao = GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
+    use_indirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+    if (use_indirect) {
+        glGenBuffers(1, &indirect_buffer);
+    }
+    pages = 0;
+    page_count = page_capacity = 0;
+    batch = 0;
+    firsts = 0;
+    counts = 0;
+    batch_capacity = 0;
+    retired = 0;
+    retired_count = retired_capacity = 0;
+    frame = 0;
+}
+
+void arena_free() {
+    for (int i = 0; i < page_count; i++) {
+        Page *page = pages + i;
+        if (use_vao) {
+            glDeleteVertexArrays(1, &page->vao);
+        }
+        glDeleteBuffers(1, &page->buffer);
+        free(page->spans);
+        free(page->commands);
+    }
+    if (use_indirect) {
+        glDeleteBuffers(1, &indirect_buffer);
+    }
+    free(pages);
+    free(batch);
+    free(firsts);
+    free(counts);
+    free(retired);
+    pages = 0;
+    page_count = page_capacity = 0;
+    batch = 0;
+    firsts = 0;
+    counts = 0;
+    batch_capacity = 0;
+    retired = 0;
+    retired_count = retired_capacity = 0;
+}
+
+static void bind_page(Page *page) {
+    glBindBuffer(GL_ARRAY_BUFFER, page->buffer);
+    for (int i = 0; i < 3; i++) {
+        glEnableVertexAttribArray(attribs[i]);
+    }
+    glVertexAttribPointer(attribs[0], 3, GL_FLOAT, GL_FALSE,
+        VERTEX_SIZE, 0);
+    glVertexAttribPointer(attribs[1], 3, GL_FLOAT, GL_FALSE,
+        VERTEX_SIZE, (GLvoid *)(sizeof(GLfloat) * 3));
+    glVertexAttribPointer(attribs[2], 4, GL_FLOAT, GL_FALSE,
+        VERTEX_SIZE, (GLvoid *)(sizeof(GLfloat) * 6));
+}
+
+static int add_page(int size) {
+    if (page_count == page_capacity) {
+        page_capacity = page_capacity ? page_capacity * 2 : 4;
+        pages = realloc(pages, sizeof(Page) * page_capacity);
+    }
+    Page *page = pages + page_count;
+    memset(page, 0, sizeof(Page));
+    page->size = size;
+    page->span_capacity = 16;
+    page->spans = malloc(sizeof(Span) * page->span_capacity);
+    page->spans[0].first = 0;
+    page->spans[0].size = size;
+    page->span_count = 1;
+    glGenBuffers(1, &page->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, page->buffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)size * VERTEX_SIZE, 0,
+        GL_DYNAMIC_DRAW);
+    if (use_vao) {
+        // the attribute layout is recorded once per page
+        glGenVertexArrays(1, &page->vao);
+        glBindVertexArray(page->vao);
+        bind_page(page);
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return page_count++;
+}
+
+static int take(Page *page, int size) {
+    for (int i = 0; i < page->span_count; i++) {
+        Span *span = page->spans + i;
+        if (span->size < size) {
+            continue;
+        }
+        int first = span->first;
+        span->first += size;
+        span->size -= size;
+        if (span->size == 0) {
+            page->span_count--;
+            memmove(span, span + 1, sizeof(Span) * (page->span_count - i));
+        }
+        return first;
+    }
+    return -1;
+}
+
+static void give(Page *page, int first, int size) {
+    int i = 0;
+    while (i < page->span_count && page->spans[i].first < first) {
+        i++;
+    }
+    Span *prev = i > 0 ? page->spans + i - 1 : 0;
+    Span *next = i < page->span_count ? page->spans + i : 0;
+    if (prev && prev->first + prev->size == first) {
+        prev->size += size;
+        if (next && prev->first + prev->size == next->first) {
+            prev->size += next->size;
+            page->span_count--;
+            memmove(next, next + 1, sizeof(Span) * (page->span_count - i));
+        }
+        return;
+    }
+    if (next && first + size == next->first) {
+        next->first = first;
+        next->size += size;
+        return;
+    }
+    if (page->span_count == page->span_capacity) {
+        page->span_capacity *= 2;
+        page->spans = realloc(
+            page->spans, sizeof(Span) * page->span_capacity);
+    }
+    Span *span = page->spans + i;
+    memmove(span + 1, span, sizeof(Span) * (page->span_count - i));
+    span->first = first;
+    span->size = size;
+    page->span_count++;
+}
+
+static void alloc_block(ArenaBlock *block, int size) {
+    for (int i = 0; i < page_count; i++) {
+        int first = take(pages + i, size);
+        if (first >= 0) {
+            block->page = i;
+            block->first = first;
+            block->size = size;
+            return;
+        }
+    }
+    int i = add_page(size > PAGE_VERTICES ? size : PAGE_VERTICES);
+    block->page = i;
+    block->first = take(pages + i, size);
+    block->size = size;
+}
+
+void arena_upload(ArenaBlock *block, int count, GLfloat *data) {
+    if (count <= 0) {
+        arena_release(block);
+        return;
+    }
+    int size = (count + GRANULE - 1) / GRANULE * GRANULE;
+    arena_release(block);
+    alloc_block(block, size);
+    Page *page = pages + block->page;
+    glBindBuffer(GL_ARRAY_BUFFER, page->buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)block->first * VERTEX_SIZE,
+        (GLsizeiptr)count * VERTEX_SIZE, data);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void arena_release(ArenaBlock *block) {
+    if (block->size) {
+        if (retired_count == retired_capacity) {
+            retired_capacity = retired_capacity ? retired_capacity * 2 : 64;
+            retired = realloc(retired, sizeof(Retired) * retired_capacity);
+        }
+        Retired *entry = retired + retired_count++;
+        entry->page = block->page;
+        entry->first = block->first;
+        entry->size = block->size;
+        entry->frame = frame;
+    }
+    block->page = 0;
+    block->first = 0;
+    block->size = 0;
+}
+
+void arena_draw(ArenaBlock *block, int count) {
+    if (!block->size || count <= 0) {
+        return;
+    }
+    Page *page = pages + block->page;
+    if (page->command_count == page->command_capacity) {
+        page->command_capacity = page->command_capacity ?
+            page->command_capacity * 2 : 64;
+        page->commands = realloc(
+            page->commands, sizeof(Command) * page->command_capacity);
+    }
+    Command *command = page->commands + page->command_count++;
+    command->count = count;
+    command->instance_count = 1;
+    command->first = block->first;
+    command->base_instance = 0;
+}
+
+static void reserve_batch(int count) {
+    if (count <= batch_capacity) {
+        return;
+    }
+    while (batch_capacity < count) {
+        batch_capacity = batch_capacity ? batch_capacity * 2 : 256;
+    }
+    batch = realloc(batch, sizeof(Command) * batch_capacity);
+    firsts = realloc(firsts, sizeof(GLint) * batch_capacity);
+    counts = realloc(counts, sizeof(GLsizei) * batch_capacity);
+}
+
+static void reclaim() {
+    frame++;
+    int count = 0;
+    for (int i = 0; i < retired_count; i++) {
+        Retired *entry = retired + i;
+        if (frame - entry->frame >= RETIRE_FRAMES) {
+            give(pages + entry->page, entry->first, entry->size);
+        }
+        else {
+            retired[count++] = *entry;
+        }
+    }
+    retired_count = count;
+}
+
+int arena_flush() {
+    // one draw call per page: glMultiDrawArraysIndirect on GL 4.3,
+    // glMultiDrawArrays from the same offsets otherwise
+    reclaim();
+    int total = 0;
+    for (int i = 0; i < page_count; i++) {
+        total += pages[i].command_count;
+    }
+    if (!total) {
+        return 0;
+    }
+    reserve_batch(total);
+    if (use_indirect) {
+        int offset = 0;
+        for (int i = 0; i < page_count; i++) {
+            Page *page = pages + i;
+            memcpy(batch + offset, page->commands,
+                sizeof(Command) * page->command_count);
+            offset += page->command_count;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(Command) * total,
+            batch, GL_STREAM_DRAW);
+    }
+    int result = 0;
+    int offset = 0;
+    for (int i = 0; i < page_count; i++) {
+        Page *page = pages + i;
+        int count = page->command_count;
+        if (!count) {
+            continue;
+        }
+        if (use_vao) {
+            glBindVertexArray(page->vao);
+        }
+        else {
+            bind_page(page);
+        }
+        if (use_indirect) {
+            glMultiDrawArraysIndirect(GL_TRIANGLES,
+                (const GLvoid *)(sizeof(Command) * offset), count, 0);
+        }
+        else {
+            for (int j = 0; j < count; j++) {
+                firsts[j] = page->commands[j].first;
+                counts[j] = page->commands[j].count;
+            }
+            glMultiDrawArrays(GL_TRIANGLES, firsts, counts, count);
+        }
+        offset += count;
+        page->command_count = 0;
+        result++;
+    }
+    if (use_vao) {
+        glBindVertexArray(0);
+    }
+    else {
+        for (int i = 0; i < 3; i++) {
+            glDisableVertexAttribArray(attribs[i]);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (use_indirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    return result;
+}
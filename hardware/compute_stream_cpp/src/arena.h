@@ -0,0 +1,21 @@
+#ifndef _arena_h_
+#define _arena_h_
+
+#include <GL/glew.h>
+
+// a range of vertices suballocated from one of the arena pages,
+// size is 0 while nothing is allocated
+typedef struct {
+    int page;
+    int first;
+    int size;
+} ArenaBlock;
+
+void arena_init(GLuint position, GLuint normal, GLuint uv);
+void arena_free();
+void arena_upload(ArenaBlock *block, int count, GLfloat *data);
+void arena_release(ArenaBlock *block);
+void arena_draw(ArenaBlock *block, int count);
+int arena_flush();
+
+#endif
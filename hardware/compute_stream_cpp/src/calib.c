@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "calib.h"
+
+#define MAX_LINE_LENGTH 1024
+#define MAX_HEADER_LENGTH 4096
+
+// the oled to slm homography of the prototype, used until a calibration
+// file is loaded
+static const double default_homography[9] = {
+    7.21986816e-03, -1.93139571e+00, 4.48421146e+03,
+    1.92107275e+00, 8.71735526e-03, -1.54284033e+03,
+    -2.57746592e-06, -2.31344956e-06, 1.00557923e+00
+};
+
+void calib_default(Calibration *calib) {
+    memcpy(calib->homography, default_homography, sizeof(default_homography));
+    calib->center[0] = calib->center[1] = 1280;
+    calib->focal[0] = calib->focal[1] = 1280;
+    memset(calib->distortion, 0, sizeof(calib->distortion));
+}
+
+static int load_npy(Calibration *calib, FILE *file) {
+    // a 3x3 little endian float64 array in c order, as written by
+    // np.save, only replaces the homography
+    unsigned char magic[10];
+    char header[MAX_HEADER_LENGTH];
+    unsigned char data[72];
+    if (fread(magic, 1, 10, file) != 10 ||
+        memcmp(magic, "\x93NUMPY", 6) != 0)
+    {
+        return 0;
+    }
+    unsigned int length = magic[8] | magic[9] << 8;
+    if (magic[6] >= 2) {
+        unsigned char extra[2];
+        if (fread(extra, 1, 2, file) != 2) {
+            return 0;
+        }
+        length |= extra[0] << 16 | extra[1] << 24;
+    }
+    if (length >= MAX_HEADER_LENGTH ||
+        fread(header, 1, length, file) != length)
+    {
+        return 0;
+    }
+    header[length] = '\0';
+    if (!strstr(header, "'<f8'") || !strstr(header, "False") ||
+        !strstr(header, "(3, 3)"))
+    {
+        return 0;
+    }
+    if (fread(data, 1, 72, file) != 72) {
+        return 0;
+    }
+    for (int i = 0; i < 9; i++) {
+        uint64_t bits = 0;
+        for (int j = 7; j >= 0; j--) {
+            bits = bits << 8 | data[i * 8 + j];
+        }
+        memcpy(calib->homography + i, &bits, sizeof(double));
+    }
+    return 1;
+}
+
+static int load_text(Calibration *calib, FILE *file) {
+    // one key per line followed by its values, # starts a comment:
+    //   homography h00 h01 h02 h10 h11 h12 h20 h21 h22
+    //   center cx cy
+    //   focal fx fy
+    //   distortion k1 k2 p1 p2 k3
+    char line[MAX_LINE_LENGTH];
+    while (fgets(line, MAX_LINE_LENGTH, file)) {
+        char key[32];
+        int n;
+        if (line[0] == '#' || sscanf(line, "%31s%n", key, &n) != 1) {
+            continue;
+        }
+        double *values;
+        int count;
+        if (strcmp(key, "homography") == 0) {
+            values = calib->homography;
+            count = 9;
+        }
+        else if (strcmp(key, "center") == 0) {
+            values = calib->center;
+            count = 2;
+        }
+        else if (strcmp(key, "focal") == 0) {
+            values = calib->focal;
+            count = 2;
+        }
+        else if (strcmp(key, "distortion") == 0) {
+            values = calib->distortion;
+            count = 5;
+        }
+        else {
+            printf("unknown calibration key: %s\n", key);
+            return 0;
+        }
+        const char *str = line + n;
+        for (int i = 0; i < count; i++) {
+            if (sscanf(str, "%lf%n", values + i, &n) != 1) {
+                printf("calibration %s needs %d values\n", key, count);
+                return 0;
+            }
+            str += n;
+        }
+    }
+    return 1;
+}
+
+int calib_load(Calibration *calib, const char *path) {
+    // calib is left unchanged if the file can not be read
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    Calibration result = *calib;
+    int length = strlen(path);
+    int ok;
+    if (length > 4 && strcmp(path + length - 4, ".npy") == 0) {
+        ok = load_npy(&result, file);
+    }
+    else {
+        ok = load_text(&result, file);
+    }
+    fclose(file);
+    if (ok && (result.focal[0] == 0 || result.focal[1] == 0)) {
+        ok = 0;
+    }
+    if (ok) {
+        *calib = result;
+    }
+    return ok;
+}
+
+int calib_map(const Calibration *calib, double x, double y,
+    double *u, double *v)
+{
+    const double *k = calib->distortion;
+    const double *h = calib->homography;
+    double a = (x - calib->center[0]) / calib->focal[0];
+    double b = (y - calib->center[1]) / calib->focal[1];
+    double r2 = a * a + b * b;
+    double radial = 1 + r2 * (k[0] + r2 * (k[1] + r2 * k[4]));
+    double da = a * radial + 2 * k[2] * a * b + k[3] * (r2 + 2 * a * a);
+    double db = b * radial + k[2] * (r2 + 2 * b * b) + 2 * k[3] * a * b;
+    x = da * calib->focal[0] + calib->center[0];
+    y = db * calib->focal[1] + calib->center[1];
+    double w = h[6] * x + h[7] * y + h[8];
+    if (w <= 0) {
+        return 0;
+    }
+    *u = (h[0] * x + h[1] * y + h[2]) / w;
+    *v = (h[3] * x + h[4] * y + h[5]) / w;
+    return 1;
+}
+
+void calib_remap(const Calibration *calib, float *data, int size,
+    int slm_width, int slm_height)
+{
+    // one texel per oled pixel, bottom row first, holding the texture
+    // coordinate of the slm image to show there or -1 outside of it
+    for (int j = 0; j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            float *texel = data + (j * size + i) * 2;
+            double u, v;
+            texel[0] = texel[1] = -1;
+            if (!calib_map(calib, i + 0.5, size - (j + 0.5), &u, &v)) {
+                continue;
+            }
+            u /= slm_width;
+            v /= slm_height;
+            if (u >= 0 && u <= 1 && v >= 0 && v <= 1) {
+                texel[0] = u;
+                texel[1] = v;
+            }
+        }
+    }
+}
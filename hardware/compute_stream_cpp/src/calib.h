@@ -0,0 +1,21 @@
+#ifndef _calib_h_
+#define _calib_h_
+
+// maps oled pixels (x right, y down) to the slm pixels they are seen on:
+// the oled position is first moved by brown-conrady lens distortion and
+// then by the homography fitted between the two displays
+typedef struct {
+    double homography[9];
+    double center[2];
+    double focal[2];
+    double distortion[5];
+} Calibration;
+
+void calib_default(Calibration *calib);
+int calib_load(Calibration *calib, const char *path);
+int calib_map(const Calibration *calib, double x, double y,
+    double *u, double *v);
+void calib_remap(const Calibration *calib, float *data, int size,
+    int slm_width, int slm_height);
+
+#endif
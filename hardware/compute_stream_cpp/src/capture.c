@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+#include "config.h"
+#include "lodepng.h"
+#include "tinycthread.h"
+
+#define MAX_PATH_LENGTH 256
+#define MAX_NAME_LENGTH (MAX_PATH_LENGTH - 32)
+
+// a slot moves from free to reading when its readback is queued, to
+// writing once the fence has passed and the pixels are mapped, and to
+// done when a writer thread has encoded them
+#define SLOT_FREE 0
+#define SLOT_READING 1
+#define SLOT_WRITING 2
+#define SLOT_DONE 3
+
+typedef struct {
+    int state;
+    int format;
+    int width;
+    int height;
+    char path[MAX_PATH_LENGTH];
+    int raw;
+    int frame;
+    double time;
+    GLuint buffer;
+    GLsizeiptr size;
+    GLsizeiptr length;
+    GLsync fence;
+    unsigned char *data;
+} Slot;
+
+static Slot slots[CAPTURE_SLOTS];
+static thrd_t writers[CAPTURE_WRITERS];
+static mtx_t mtx;
+static cnd_t cnd;
+static int queue[CAPTURE_SLOTS];
+static int queue_start;
+static int queue_count;
+static int running;
+static int use_pbo;
+static int use_sync;
+static CaptureStats stats;
+static FILE *index_file;
+static char record_name[MAX_NAME_LENGTH + 1];
+static int record_frame;
+
+static const char *kinds[] = {"rgb", "depth", "phase", "diopter"};
+
+static void pixel_format(int format, GLenum *gl_format, GLenum *gl_type,
+    int *bytes)
+{
+    switch (format) {
+        case CAPTURE_RGB:
+            *gl_format = GL_RGB; *gl_type = GL_UNSIGNED_BYTE; *bytes = 3;
+            break;
+        case CAPTURE_DEPTH:
+            *gl_format = GL_DEPTH_COMPONENT; *gl_type = GL_SHORT; *bytes = 2;
+            break;
+        case CAPTURE_DIOPTER:
+            *gl_format = GL_RED; *gl_type = GL_SHORT; *bytes = 2;
+            break;
+        default:
+            *gl_format = GL_RED; *gl_type = GL_UNSIGNED_BYTE; *bytes = 1;
+            break;
+    }
+}
+
+static int write_raw(Slot *slot) {
+    // raw frames are stored as read, bottom row first, and listed in the
+    // index once they are complete on disk
+    FILE *file = fopen(slot->path, "wb");
+    if (!file) {
+        fprintf(stderr, "capture %s failed to open\n", slot->path);
+        return 0;
+    }
+    size_t count = fwrite(slot->data, 1, slot->length, file);
+    if (fclose(file) != 0 || count != (size_t)slot->length) {
+        fprintf(stderr, "capture %s failed to write\n", slot->path);
+        return 0;
+    }
+    mtx_lock(&mtx);
+    if (index_file) {
+        fprintf(index_file, "%d,%.6f,%s,%d,%d,%s\n",
+            slot->frame, slot->time, kinds[slot->format],
+            slot->width, slot->height, slot->path);
+    }
+    mtx_unlock(&mtx);
+    return 1;
+}
+
+static int write_slot(Slot *slot) {
+    if (slot->raw) {
+        return write_raw(slot);
+    }
+    LodePNGColorType type = slot->format == CAPTURE_RGB ? LCT_RGB : LCT_GREY;
+    unsigned int bitdepth = slot->format == CAPTURE_DEPTH ||
+        slot->format == CAPTURE_DIOPTER ? 16 : 8;
+    unsigned int error = lodepng_encode_file(
+        slot->path, slot->data, slot->width, slot->height, type, bitdepth);
+    if (error) {
+        fprintf(stderr, "capture %s failed, error %u: %s\n",
+            slot->path, error, lodepng_error_text(error));
+        return 0;
+    }
+    return 1;
+}
+
+static int writer_run(void *arg) {
+    while (1) {
+        mtx_lock(&mtx);
+        while (running && !queue_count) {
+            cnd_wait(&cnd, &mtx);
+        }
+        if (!queue_count) {
+            // cnd_broadcast only wakes one thread in this tinycthread,
+            // so each exiting writer wakes the next
+            cnd_signal(&cnd);
+            mtx_unlock(&mtx);
+            break;
+        }
+        int index = queue[queue_start];
+        queue_start = (queue_start + 1) % CAPTURE_SLOTS;
+        queue_count--;
+        mtx_unlock(&mtx);
+        int ok = write_slot(slots + index);
+        mtx_lock(&mtx);
+        slots[index].state = SLOT_DONE;
+        if (ok) {
+            stats.written++;
+        }
+        else {
+            stats.failed++;
+        }
+        mtx_unlock(&mtx);
+    }
+    return 0;
+}
+
+void capture_init() {
+    use_pbo = GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object;
+    use_sync = use_pbo && (GLEW_VERSION_3_2 || GLEW_ARB_sync);
+    memset(slots, 0, sizeof(slots));
+    memset(&stats, 0, sizeof(stats));
+    queue_start = queue_count = 0;
+    running = 1;
+    mtx_init(&mtx, mtx_plain);
+    cnd_init(&cnd);
+    for (int i = 0; i < CAPTURE_WRITERS; i++) {
+        if (thrd_create(writers + i, writer_run, NULL) != thrd_success) {
+            perror("thrd_create");
+            exit(1);
+        }
+    }
+}
+
+static int slot_state(Slot *slot) {
+    mtx_lock(&mtx);
+    int result = slot->state;
+    mtx_unlock(&mtx);
+    return result;
+}
+
+static void submit(Slot *slot) {
+    mtx_lock(&mtx);
+    slot->state = SLOT_WRITING;
+    queue[(queue_start + queue_count) % CAPTURE_SLOTS] = slot - slots;
+    queue_count++;
+    cnd_signal(&cnd);
+    mtx_unlock(&mtx);
+}
+
+static Slot *begin(const char *path, int format, int width, int height) {
+    // a capture is dropped rather than waited for when every slot is busy,
+    // so the render thread never blocks on readback or encoding
+    Slot *slot = 0;
+    mtx_lock(&mtx);
+    stats.requested++;
+    for (int i = 0; i < CAPTURE_SLOTS; i++) {
+        if (slots[i].state == SLOT_FREE) {
+            slot = slots + i;
+            break;
+        }
+    }
+    if (!slot) {
+        stats.dropped++;
+    }
+    mtx_unlock(&mtx);
+    if (!slot) {
+        return 0;
+    }
+    GLenum gl_format, gl_type;
+    int bytes;
+    pixel_format(format, &gl_format, &gl_type, &bytes);
+    GLsizeiptr size = (GLsizeiptr)width * height * bytes;
+    snprintf(slot->path, MAX_PATH_LENGTH, "%s", path);
+    slot->raw = 0;
+    slot->length = size;
+    slot->format = format;
+    slot->width = width;
+    slot->height = height;
+    if (use_pbo) {
+        if (!slot->buffer) {
+            glGenBuffers(1, &slot->buffer);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+        if (slot->size < size) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+            slot->size = size;
+        }
+    }
+    else if (slot->size < size) {
+        slot->data = realloc(slot->data, size);
+        slot->size = size;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    return slot;
+}
+
+static void finish(Slot *slot) {
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    if (!use_pbo) {
+        submit(slot);
+        return;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (use_sync) {
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+    }
+    mtx_lock(&mtx);
+    slot->state = SLOT_READING;
+    mtx_unlock(&mtx);
+}
+
+static void read_pixels(Slot *slot, GLuint texture) {
+    GLenum gl_format, gl_type;
+    int bytes;
+    pixel_format(slot->format, &gl_format, &gl_type, &bytes);
+    GLvoid *data = use_pbo ? 0 : slot->data;
+    if (texture) {
+        GLint previous;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexImage(GL_TEXTURE_2D, 0, gl_format, gl_type, data);
+        glBindTexture(GL_TEXTURE_2D, previous);
+    }
+    else {
+        glReadPixels(0, 0, slot->width, slot->height,
+            gl_format, gl_type, data);
+    }
+    finish(slot);
+}
+
+static void read_source(Slot *slot, CaptureSource *source) {
+    if (source->texture) {
+        read_pixels(slot, source->texture);
+        return;
+    }
+    GLint framebuffer, buffer;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &framebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source->framebuffer);
+    glGetIntegerv(GL_READ_BUFFER, &buffer);
+    glReadBuffer(source->buffer);
+    read_pixels(slot, 0);
+    glReadBuffer(buffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+}
+
+int capture_texture(
+    const char *path, int format, GLuint texture, int width, int height)
+{
+    Slot *slot = begin(path, format, width, height);
+    if (!slot) {
+        return 0;
+    }
+    read_pixels(slot, texture);
+    return 1;
+}
+
+int capture_framebuffer(const char *path, int format, int width, int height) {
+    Slot *slot = begin(path, format, width, height);
+    if (!slot) {
+        return 0;
+    }
+    read_pixels(slot, 0);
+    return 1;
+}
+
+void capture_poll() {
+    // maps readbacks whose fence has passed and unmaps written slots,
+    // neither of which waits on the gpu
+    for (int i = 0; i < CAPTURE_SLOTS; i++) {
+        Slot *slot = slots + i;
+        int state = slot_state(slot);
+        if (state == SLOT_READING) {
+            if (slot->fence) {
+                GLenum result = glClientWaitSync(slot->fence, 0, 0);
+                if (result == GL_TIMEOUT_EXPIRED) {
+                    continue;
+                }
+                glDeleteSync(slot->fence);
+                slot->fence = 0;
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+            slot->data = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            if (slot->data) {
+                submit(slot);
+            }
+            else {
+                fprintf(stderr, "capture %s failed to map\n", slot->path);
+                mtx_lock(&mtx);
+                stats.failed++;
+                slot->state = SLOT_FREE;
+                mtx_unlock(&mtx);
+            }
+        }
+        else if (state == SLOT_DONE) {
+            if (use_pbo) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                slot->data = 0;
+            }
+            mtx_lock(&mtx);
+            slot->state = SLOT_FREE;
+            mtx_unlock(&mtx);
+        }
+    }
+}
+
+void capture_stats(CaptureStats *result) {
+    mtx_lock(&mtx);
+    *result = stats;
+    mtx_unlock(&mtx);
+}
+
+static void drain() {
+    glFinish();
+    while (1) {
+        capture_poll();
+        int busy = 0;
+        for (int i = 0; i < CAPTURE_SLOTS; i++) {
+            busy |= slot_state(slots + i) != SLOT_FREE;
+        }
+        if (!busy) {
+            break;
+        }
+        thrd_yield();
+    }
+}
+
+int capture_record_start(const char *name) {
+    capture_record_stop();
+    if (strlen(name) > MAX_NAME_LENGTH) {
+        fprintf(stderr, "capture name longer than %d characters\n",
+            MAX_NAME_LENGTH);
+        return 0;
+    }
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, MAX_PATH_LENGTH, "%s.csv", name);
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "capture %s failed to open\n", path);
+        return 0;
+    }
+    fprintf(file, "frame,time,kind,width,height,file\n");
+    snprintf(record_name, MAX_PATH_LENGTH, "%s", name);
+    record_frame = 0;
+    mtx_lock(&mtx);
+    index_file = file;
+    stats.frames = 0;
+    stats.dropped_frames = 0;
+    mtx_unlock(&mtx);
+    return 1;
+}
+
+void capture_record_stop() {
+    if (!index_file) {
+        return;
+    }
+    drain();
+    mtx_lock(&mtx);
+    fclose(index_file);
+    index_file = 0;
+    mtx_unlock(&mtx);
+}
+
+int capture_recording() {
+    return index_file != 0;
+}
+
+int capture_record(double time, CaptureSource *sources, int count) {
+    // a frame is recorded whole or not at all, so the index never lists
+    // a color image without its depth and phase mask
+    if (!index_file) {
+        return 0;
+    }
+    int available = 0;
+    mtx_lock(&mtx);
+    for (int i = 0; i < CAPTURE_SLOTS; i++) {
+        available += slots[i].state == SLOT_FREE;
+    }
+    if (available < count) {
+        stats.dropped_frames++;
+    }
+    else {
+        stats.frames++;
+    }
+    mtx_unlock(&mtx);
+    if (available < count) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        CaptureSource *source = sources + i;
+        char path[MAX_PATH_LENGTH];
+        snprintf(path, MAX_PATH_LENGTH, "%s_%06d_%s.raw",
+            record_name, record_frame, kinds[source->format]);
+        Slot *slot = begin(
+            path, source->format, source->width, source->height);
+        slot->raw = 1;
+        slot->frame = record_frame;
+        slot->time = time;
+        read_source(slot, source);
+    }
+    record_frame++;
+    return 1;
+}
+
+void capture_free() {
+    // finish every pending capture before the writers are stopped
+    capture_record_stop();
+    drain();
+    mtx_lock(&mtx);
+    running = 0;
+    cnd_signal(&cnd);
+    mtx_unlock(&mtx);
+    for (int i = 0; i < CAPTURE_WRITERS; i++) {
+        thrd_join(writers[i], NULL);
+    }
+    cnd_destroy(&cnd);
+    mtx_destroy(&mtx);
+    for (int i = 0; i < CAPTURE_SLOTS; i++) {
+        Slot *slot = slots + i;
+        if (use_pbo) {
+            glDeleteBuffers(1, &slot->buffer);
+        }
+        else {
+            free(slot->data);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef _capture_h_
+#define _capture_h_
+
+#include <GL/glew.h>
+
+// 8 bit rgb, 16 bit depth (GL_SHORT, written as-is), 8 bit phase mask and
+// normalized diopters read from the red channel as 16 bit GL_SHORT
+#define CAPTURE_RGB 0
+#define CAPTURE_DEPTH 1
+#define CAPTURE_PHASE 2
+#define CAPTURE_DIOPTER 3
+
+typedef struct {
+    unsigned int requested;
+    unsigned int written;
+    unsigned int dropped;
+    unsigned int failed;
+    unsigned int frames;
+    unsigned int dropped_frames;
+} CaptureStats;
+
+// a texture of 0 reads the lower left corner of the given buffer of a
+// framebuffer
+typedef struct {
+    int format;
+    GLuint texture;
+    int width;
+    int height;
+    GLuint framebuffer;
+    GLenum buffer;
+} CaptureSource;
+
+void capture_init();
+void capture_free();
+int capture_texture(
+    const char *path, int format, GLuint texture, int width, int height);
+int capture_framebuffer(const char *path, int format, int width, int height);
+void capture_poll();
+int capture_record_start(const char *name);
+void capture_record_stop();
+int capture_recording();
+int capture_record(double time, CaptureSource *sources, int count);
+void capture_stats(CaptureStats *stats);
+
+#endif
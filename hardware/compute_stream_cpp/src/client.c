@@ -2,9 +2,13 @@
     #include <winsock2.h>
     #include <windows.h>
     #define close closesocket
-    #define sleep Sleep
+    #define poll WSAPoll
+    typedef int socklen_t;
 #else
+    #include <errno.h>
+    #include <fcntl.h>
     #include <netdb.h>
+    #include <poll.h>
     #include <unistd.h>
 #endif
 
@@ -16,17 +20,78 @@
 
 #define QUEUE_SIZE 1048576
 #define RECV_SIZE 4096
+#define FRAME_HEADER_SIZE 5
+#define MAX_FRAME_SIZE (QUEUE_SIZE / 4)
+#define RECORD_HEADER_SIZE 5
+#define SEND_SIZE 65536
+#define IO_TICK 5
+#define CONNECT_TIMEOUT 5000
+#define MIN_RECONNECT_DELAY 250
+#define MAX_RECONNECT_DELAY 8000
+
+#ifdef MSG_NOSIGNAL
+    #define SEND_FLAGS MSG_NOSIGNAL
+#else
+    #define SEND_FLAGS 0
+#endif
 
 static int client_enabled = 0;
 static int running = 0;
-static int sd = 0;
+static int sd = -1;
+static char hostname[256];
+static int port = 0;
 static int bytes_sent = 0;
 static int bytes_received = 0;
-static char *queue = 0;
-static int qsize = 0;
-static thrd_t recv_thread;
+static int protocol = PROTOCOL_TEXT;
+static int requested_protocol = PROTOCOL_TEXT;
+static thrd_t io_thread;
 static mtx_t mutex;
 
+// outgoing messages are appended by the render thread and written by the
+// io thread, which swaps the two buffers once per tick.
+static mtx_t send_mutex;
+static char *send_buffer = 0;
+static int send_size = 0;
+static int send_capacity = 0;
+static char *out_buffer = 0;
+static int out_size = 0;
+static int out_capacity = 0;
+static int out_offset = 0;
+static char version_line[64];
+static char login_line[1024];
+static int reconnected = 0;
+static int position_sent = 0;
+
+// received messages are kept in a bip buffer so that every record is
+// contiguous and can be handed to the caller in place. records are
+// [type][uint32 length][payload]['\0'].
+static char *queue = 0;
+static cnd_t queue_space;
+static int queue_head = 0;
+static int queue_tail = 0;
+static int queue_wrap = 0;
+static int queue_wrapped = 0;
+static int write_tail = 0;
+static int reading = 0;
+static int read_cursor = 0;
+static int read_end = 0;
+static int read_next_end = 0;
+static int read_wrapped = 0;
+static int read_unwrapped = 0;
+static int read_bytes = 0;
+
+static unsigned int read_uint32(const char *data) {
+    const unsigned char *b = (const unsigned char *)data;
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned int)b[3] << 24);
+}
+
+static void write_uint32(char *data, unsigned int value) {
+    data[0] = value & 0xff;
+    data[1] = (value >> 8) & 0xff;
+    data[2] = (value >> 16) & 0xff;
+    data[3] = (value >> 24) & 0xff;
+}
+
 void client_enable() {
     client_enabled = 1;
 }
@@ -39,49 +104,61 @@ int get_client_enabled() {
     return client_enabled;
 }
 
-int client_sendall(int sd, char *data, int length) {
-    if (!client_enabled) {
-        return 0;
-    }
-    int count = 0;
-    while (count < length) {
-        int n = send(sd, data + count, length, 0);
-        if (n == -1) {
-            return -1;
+static void append(char **buffer, int *size, int *capacity,
+    const char *data, int length)
+{
+    if (*size + length > *capacity) {
+        int capacity_needed = *capacity ? *capacity : SEND_SIZE;
+        while (capacity_needed < *size + length) {
+            capacity_needed *= 2;
         }
-        count += n;
-        length -= n;
-        bytes_sent += n;
+        *buffer = realloc(*buffer, capacity_needed);
+        *capacity = capacity_needed;
     }
-    return 0;
+    memcpy(*buffer + *size, data, length);
+    *size += length;
 }
 
 void client_send(char *data) {
     if (!client_enabled) {
         return;
     }
-    if (client_sendall(sd, data, strlen(data)) == -1) {
-        perror("client_sendall");
-        exit(1);
+    mtx_lock(&send_mutex);
+    append(&send_buffer, &send_size, &send_capacity, data, strlen(data));
+    mtx_unlock(&send_mutex);
+}
+
+int client_reconnected() {
+    if (!client_enabled) {
+        return 0;
     }
+    mtx_lock(&send_mutex);
+    int result = reconnected;
+    reconnected = 0;
+    mtx_unlock(&send_mutex);
+    return result;
 }
 
 void client_version(int version) {
     if (!client_enabled) {
         return;
     }
-    char buffer[1024];
-    snprintf(buffer, 1024, "V,%d\n", version);
-    client_send(buffer);
+    requested_protocol = version;
+    mtx_lock(&send_mutex);
+    snprintf(version_line, sizeof(version_line), "V,%d\n", version);
+    mtx_unlock(&send_mutex);
+    client_send(version_line);
 }
 
 void client_login(const char *username, const char *identity_token) {
     if (!client_enabled) {
         return;
     }
-    char buffer[1024];
-    snprintf(buffer, 1024, "A,%s,%s\n", username, identity_token);
-    client_send(buffer);
+    mtx_lock(&send_mutex);
+    snprintf(login_line, sizeof(login_line), "A,%s,%s\n",
+        username, identity_token);
+    mtx_unlock(&send_mutex);
+    client_send(login_line);
 }
 
 void client_position(float x, float y, float z, float rx, float ry) {
@@ -95,7 +172,12 @@ void client_position(float x, float y, float z, float rx, float ry) {
         (pz - z) * (pz - z) +
         (prx - rx) * (prx - rx) +
         (pry - ry) * (pry - ry);
-    if (distance < 0.0001) {
+    // reconnect clears position_sent on the io thread
+    mtx_lock(&send_mutex);
+    int unchanged = position_sent && distance < 0.0001;
+    position_sent = 1;
+    mtx_unlock(&send_mutex);
+    if (unchanged) {
         return;
     }
     px = x; py = y; pz = z; prx = rx; pry = ry;
@@ -113,6 +195,15 @@ void client_chunk(int p, int q, int key) {
     client_send(buffer);
 }
 
+void client_cancel(int p, int q) {
+    if (!client_enabled) {
+        return;
+    }
+    char buffer[1024];
+    snprintf(buffer, 1024, "X,%d,%d\n", p, q);
+    client_send(buffer);
+}
+
 void client_block(int x, int y, int z, int w) {
     if (!client_enabled) {
         return;
@@ -152,85 +243,345 @@ void client_talk(const char *text) {
     client_send(buffer);
 }
 
-char *client_recv() {
+int client_recv(char **data, int *length) {
     if (!client_enabled) {
         return 0;
     }
+    if (!reading) {
+        mtx_lock(&mutex);
+        read_cursor = queue_head;
+        read_wrapped = queue_wrapped;
+        read_end = read_wrapped ? queue_wrap : queue_tail;
+        read_next_end = queue_tail;
+        mtx_unlock(&mutex);
+        read_unwrapped = 0;
+        read_bytes = 0;
+        reading = 1;
+    }
+    if (read_cursor == read_end && read_wrapped) {
+        read_cursor = 0;
+        read_end = read_next_end;
+        read_wrapped = 0;
+        read_unwrapped = 1;
+    }
+    if (read_cursor == read_end) {
+        return 0;
+    }
+    char *record = queue + read_cursor;
+    int size = RECORD_HEADER_SIZE + read_uint32(record + 1) + 1;
+    *data = record + RECORD_HEADER_SIZE;
+    *length = size - RECORD_HEADER_SIZE - 1;
+    read_cursor += size;
+    read_bytes += size;
+    return record[0];
+}
+
+void client_recv_done() {
+    if (!client_enabled || !reading) {
+        return;
+    }
+    mtx_lock(&mutex);
+    if (read_unwrapped) {
+        queue_wrapped = 0;
+    }
+    queue_head = read_cursor;
+    bytes_received += read_bytes;
+    cnd_signal(&queue_space);
+    mtx_unlock(&mutex);
+    reading = 0;
+}
+
+int client_chunk_runs(
+    const char *data, int length, int *p, int *q, const unsigned char **runs)
+{
+    if (length < 12) {
+        return 0;
+    }
+    int count = read_uint32(data + 8);
+    if (count < 0 || count > (length - 12) / CHUNK_RUN_SIZE) {
+        return 0;
+    }
+    *p = (int)read_uint32(data);
+    *q = (int)read_uint32(data + 4);
+    *runs = (const unsigned char *)(data + 12);
+    return count;
+}
+
+static char *reserve(int size) {
     char *result = 0;
     mtx_lock(&mutex);
-    char *p = queue + qsize - 1;
-    while (p >= queue && *p != '\n') {
-        p--;
-    }
-    if (p >= queue) {
-        int length = p - queue + 1;
-        result = malloc(sizeof(char) * (length + 1));
-        memcpy(result, queue, sizeof(char) * length);
-        result[length] = '\0';
-        int remaining = qsize - length;
-        memmove(queue, p + 1, remaining);
-        qsize -= length;
-        bytes_received += length;
+    while (running) {
+        if (queue_wrapped) {
+            if (queue_head - write_tail > size) {
+                result = queue + write_tail;
+                break;
+            }
+        }
+        else if (QUEUE_SIZE - write_tail >= size) {
+            result = queue + write_tail;
+            break;
+        }
+        else if (queue_head > size) {
+            queue_wrap = write_tail;
+            queue_wrapped = 1;
+            queue_tail = write_tail = 0;
+            result = queue;
+            break;
+        }
+        // publish what has been written so the consumer can free space
+        queue_tail = write_tail;
+        cnd_wait(&queue_space, &mutex);
     }
     mtx_unlock(&mutex);
     return result;
 }
 
-int recv_worker(void *arg) {
-    char *data = malloc(sizeof(char) * RECV_SIZE);
-    while (1) {
-        int length;
-        if ((length = recv(sd, data, RECV_SIZE - 1, 0)) <= 0) {
-            if (running) {
-                perror("recv");
-                exit(1);
+static void publish() {
+    mtx_lock(&mutex);
+    queue_tail = write_tail;
+    mtx_unlock(&mutex);
+}
+
+static void enqueue(char type, const char *data, int length) {
+    int size = RECORD_HEADER_SIZE + length + 1;
+    char *record = reserve(size);
+    if (!record) {
+        return;
+    }
+    record[0] = type;
+    write_uint32(record + 1, length);
+    memcpy(record + RECORD_HEADER_SIZE, data, sizeof(char) * length);
+    record[size - 1] = '\0';
+    write_tail += size;
+}
+
+static void enqueue_lines(const char *data, int length) {
+    const char *end = data + length;
+    while (data < end) {
+        const char *newline = memchr(data, '\n', end - data);
+        if (!newline) {
+            newline = end;
+        }
+        if (newline > data) {
+            enqueue(FRAME_TEXT, data, newline - data);
+        }
+        data = newline + 1;
+    }
+}
+
+static int decode(char *data, int size) {
+    int used = 0;
+    while (used < size) {
+        char *start = data + used;
+        int remaining = size - used;
+        if (protocol == PROTOCOL_TEXT) {
+            char *newline = memchr(start, '\n', remaining);
+            if (!newline) {
+                break;
+            }
+            int length = newline - start + 1;
+            // the version ack is the last text line before framing starts
+            if (requested_protocol != protocol &&
+                start[0] == 'V' && start[1] == ',')
+            {
+                protocol = requested_protocol = atoi(start + 2);
             }
             else {
-                break;
+                enqueue_lines(start, length);
             }
+            used += length;
         }
-        data[length] = '\0';
-        while (1) {
-            int done = 0;
-            mtx_lock(&mutex);
-            if (qsize + length < QUEUE_SIZE) {
-                memcpy(queue + qsize, data, sizeof(char) * (length + 1));
-                qsize += length;
-                done = 1;
+        else {
+            if (remaining < FRAME_HEADER_SIZE) {
+                break;
+            }
+            unsigned int length = read_uint32(start);
+            if (length > MAX_FRAME_SIZE) {
+                fprintf(stderr, "recv: frame too large (%u bytes)\n", length);
+                exit(1);
             }
-            mtx_unlock(&mutex);
-            if (done) {
+            if (remaining < FRAME_HEADER_SIZE + (int)length) {
                 break;
             }
-            sleep(0);
+            char *payload = start + FRAME_HEADER_SIZE;
+            if (start[4] == FRAME_TEXT) {
+                enqueue_lines(payload, length);
+            }
+            else if (start[4] == FRAME_CHUNK) {
+                enqueue(FRAME_CHUNK, payload, length);
+            }
+            used += FRAME_HEADER_SIZE + length;
         }
     }
-    free(data);
-    return 0;
+    publish();
+    return used;
 }
 
-void client_connect(char *hostname, int port) {
-    if (!client_enabled) {
-        return;
-    }
+static int would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS;
+#endif
+}
+
+static void set_nonblocking(int fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket(fd, FIONBIO, &mode);
+#else
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+static int open_socket(const char *name, int port_number) {
     struct hostent *host;
     struct sockaddr_in address;
-    if ((host = gethostbyname(hostname)) == 0) {
-        perror("gethostbyname");
-        exit(1);
+    if ((host = gethostbyname(name)) == 0) {
+        return -1;
     }
     memset(&address, 0, sizeof(address));
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = ((struct in_addr *)(host->h_addr_list[0]))->s_addr;
-    address.sin_port = htons(port);
-    if ((sd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-        perror("socket");
-        exit(1);
+    address.sin_port = htons(port_number);
+    int fd;
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+        return -1;
+    }
+    set_nonblocking(fd);
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+        if (!would_block()) {
+            close(fd);
+            return -1;
+        }
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (poll(&pfd, 1, CONNECT_TIMEOUT) != 1 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, (char *)&error, &length) ||
+            error)
+        {
+            close(fd);
+            return -1;
+        }
     }
-    if (connect(sd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+    return fd;
+}
+
+static void wait_ms(int milliseconds) {
+    // thrd_sleep takes an absolute time
+    struct timespec ts;
+    clock_gettime(TIME_UTC, &ts);
+    ts.tv_nsec += milliseconds * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    thrd_sleep(&ts, NULL);
+}
+
+static void reconnect() {
+    close(sd);
+    sd = -1;
+    int delay = MIN_RECONNECT_DELAY;
+    while (running) {
+        printf("Reconnecting to %s:%d...\n", hostname, port);
+        if ((sd = open_socket(hostname, port)) != -1) {
+            break;
+        }
+        for (int i = 0; running && i < delay; i += IO_TICK) {
+            wait_ms(IO_TICK);
+        }
+        delay = delay * 2 < MAX_RECONNECT_DELAY ? delay * 2 : MAX_RECONNECT_DELAY;
+    }
+    // start over in text mode and replay the handshake before anything else
+    protocol = PROTOCOL_TEXT;
+    mtx_lock(&send_mutex);
+    requested_protocol = atoi(version_line + 2);
+    out_size = out_offset = 0;
+    append(&out_buffer, &out_size, &out_capacity,
+        version_line, strlen(version_line));
+    append(&out_buffer, &out_size, &out_capacity,
+        login_line, strlen(login_line));
+    reconnected = 1;
+    position_sent = 0;
+    mtx_unlock(&send_mutex);
+}
+
+static int flush() {
+    if (out_offset == out_size) {
+        out_size = out_offset = 0;
+        mtx_lock(&send_mutex);
+        char *buffer = out_buffer;
+        int capacity = out_capacity;
+        out_buffer = send_buffer;
+        out_size = send_size;
+        out_capacity = send_capacity;
+        send_buffer = buffer;
+        send_size = 0;
+        send_capacity = capacity;
+        mtx_unlock(&send_mutex);
+    }
+    while (out_offset < out_size) {
+        int n = send(sd, out_buffer + out_offset, out_size - out_offset,
+            SEND_FLAGS);
+        if (n == -1) {
+            return would_block() ? 0 : -1;
+        }
+        out_offset += n;
+        bytes_sent += n;
+    }
+    return 0;
+}
+
+int io_worker(void *arg) {
+    int capacity = MAX_FRAME_SIZE + FRAME_HEADER_SIZE + RECV_SIZE;
+    char *data = malloc(sizeof(char) * capacity);
+    int size = 0;
+    while (running) {
+        struct pollfd pfd = {sd, POLLIN, 0};
+        if (out_offset < out_size) {
+            pfd.events |= POLLOUT;
+        }
+        // the timeout doubles as the send tick: messages queued by the
+        // render thread in the meantime go out together
+        poll(&pfd, 1, IO_TICK);
+        if (!running) {
+            break;
+        }
+        int error = flush() == -1;
+        if (!error && (pfd.revents & (POLLIN | POLLERR | POLLHUP))) {
+            int length = recv(sd, data + size, capacity - size, 0);
+            if (length > 0) {
+                size += length;
+                int used = decode(data, size);
+                if (used) {
+                    size -= used;
+                    memmove(data, data + used, size);
+                }
+            }
+            else if (length == 0 || !would_block()) {
+                error = 1;
+            }
+        }
+        if (error && running) {
+            printf("Connection to %s:%d lost\n", hostname, port);
+            size = 0;
+            reconnect();
+        }
+    }
+    free(data);
+    return 0;
+}
+
+void client_connect(char *name, int port_number) {
+    if (!client_enabled) {
+        return;
+    }
+    if ((sd = open_socket(name, port_number)) == -1) {
         perror("connect");
         exit(1);
     }
+    strncpy(hostname, name, sizeof(hostname) - 1);
+    port = port_number;
 }
 
 void client_start() {
@@ -239,9 +590,17 @@ void client_start() {
     }
     running = 1;
     queue = (char *)calloc(QUEUE_SIZE, sizeof(char));
-    qsize = 0;
+    queue_head = queue_tail = write_tail = 0;
+    queue_wrap = queue_wrapped = 0;
+    reading = 0;
+    protocol = requested_protocol = PROTOCOL_TEXT;
+    send_size = out_size = out_offset = 0;
+    version_line[0] = login_line[0] = '\0';
+    reconnected = 0;
     mtx_init(&mutex, mtx_plain);
-    if (thrd_create(&recv_thread, recv_worker, NULL) != thrd_success) {
+    mtx_init(&send_mutex, mtx_plain);
+    cnd_init(&queue_space);
+    if (thrd_create(&io_thread, io_worker, NULL) != thrd_success) {
         perror("thrd_create");
         exit(1);
     }
@@ -251,14 +610,19 @@ void client_stop() {
     if (!client_enabled) {
         return;
     }
+    mtx_lock(&mutex);
     running = 0;
+    cnd_signal(&queue_space);
+    mtx_unlock(&mutex);
+    if (thrd_join(io_thread, NULL) != thrd_success) {
+        perror("thrd_join");
+        exit(1);
+    }
     close(sd);
-    // if (thrd_join(recv_thread, NULL) != thrd_success) {
-    //     perror("thrd_join");
-    //     exit(1);
-    // }
-    // mtx_destroy(&mutex);
-    qsize = 0;
+    sd = -1;
+    mtx_destroy(&mutex);
+    mtx_destroy(&send_mutex);
+    cnd_destroy(&queue_space);
     free(queue);
     // printf("Bytes Sent: %d, Bytes Received: %d\n",
     //     bytes_sent, bytes_received);
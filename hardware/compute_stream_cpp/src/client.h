@@ -3,6 +3,13 @@
 
 #define DEFAULT_PORT 4080
 
+#define PROTOCOL_TEXT 1
+#define PROTOCOL_BINARY 2
+
+#define FRAME_TEXT 'T'
+#define FRAME_CHUNK 'C'
+#define CHUNK_RUN_SIZE 5
+
 void client_enable();
 void client_disable();
 int get_client_enabled();
@@ -10,11 +17,16 @@ void client_connect(char *hostname, int port);
 void client_start();
 void client_stop();
 void client_send(char *data);
-char *client_recv();
+int client_reconnected();
+int client_recv(char **data, int *length);
+void client_recv_done();
+int client_chunk_runs(
+    const char *data, int length, int *p, int *q, const unsigned char **runs);
 void client_version(int version);
 void client_login(const char *username, const char *identity_token);
 void client_position(float x, float y, float z, float rx, float ry);
 void client_chunk(int p, int q, int key);
+void client_cancel(int p, int q);
 void client_block(int x, int y, int z, int w);
 void client_light(int x, int y, int z, int w);
 void client_sign(int x, int y, int z, int face, const char *text);
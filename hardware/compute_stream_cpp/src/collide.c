@@ -0,0 +1,184 @@
+#include <math.h>
+#include "collide.h"
+#include "config.h"
+#include "item.h"
+
+#define PAD 0.25f
+#define EPSILON 1e-4f
+
+typedef struct {
+    CollideWindow *window;
+    collide_chunk_func func;
+    void *arg;
+} Context;
+
+static int chunked(int x) {
+    return x >= 0 ? x / CHUNK_SIZE : (x + 1) / CHUNK_SIZE - 1;
+}
+
+static void fill(Context *context, int x, int y, int z) {
+    // the window is filled a column at a time with one chunk lookup per
+    // chunk it overlaps
+    CollideWindow *window = context->window;
+    window->valid = 1;
+    window->x = x - COLLIDE_SIZE / 2;
+    window->y = y - COLLIDE_SIZE / 2;
+    window->z = z - COLLIDE_SIZE / 2;
+    int p = 0;
+    int q = 0;
+    Map *map = 0;
+    int loaded = 0;
+    for (int dx = 0; dx < COLLIDE_SIZE; dx++) {
+        for (int dz = 0; dz < COLLIDE_SIZE; dz++) {
+            int bx = window->x + dx;
+            int bz = window->z + dz;
+            if (!loaded || chunked(bx) != p || chunked(bz) != q) {
+                p = chunked(bx);
+                q = chunked(bz);
+                map = context->func(p, q, context->arg);
+                loaded = 1;
+            }
+            for (int dy = 0; dy < COLLIDE_SIZE; dy++) {
+                int by = window->y + dy;
+                int w = 0;
+                if (map && by >= 0 && by < 256) {
+                    w = map_get(map, bx, by, bz);
+                }
+                window->solid[dx][dy][dz] = is_obstacle(w);
+            }
+        }
+    }
+}
+
+static int solid(Context *context, int x, int y, int z) {
+    CollideWindow *window = context->window;
+    int dx = x - window->x;
+    int dy = y - window->y;
+    int dz = z - window->z;
+    if (!window->valid ||
+        dx < 0 || dy < 0 || dz < 0 ||
+        dx >= COLLIDE_SIZE || dy >= COLLIDE_SIZE || dz >= COLLIDE_SIZE)
+    {
+        fill(context, x, y, z);
+        dx = x - window->x;
+        dy = y - window->y;
+        dz = z - window->z;
+    }
+    return window->solid[dx][dy][dz];
+}
+
+static int first_block(float a) {
+    // first block i spanning [i - 0.5, i + 0.5] that reaches past a
+    return (int)floorf(a + EPSILON - 0.5f) + 1;
+}
+
+static int last_block(float b) {
+    return (int)ceilf(b - EPSILON + 0.5f) - 1;
+}
+
+static int blocked(Context *context, float lo[3], float hi[3], int axis,
+    int i)
+{
+    int u = (axis + 1) % 3;
+    int v = (axis + 2) % 3;
+    int u0 = first_block(lo[u]);
+    int u1 = last_block(hi[u]);
+    int v0 = first_block(lo[v]);
+    int v1 = last_block(hi[v]);
+    int block[3];
+    block[axis] = i;
+    for (int a = u0; a <= u1; a++) {
+        for (int b = v0; b <= v1; b++) {
+            block[u] = a;
+            block[v] = b;
+            if (solid(context, block[0], block[1], block[2])) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static float sweep(Context *context, float lo[3], float hi[3], int axis,
+    float d)
+{
+    // visits the layers of blocks the box face sweeps through in order
+    // and stops at the first layer with an obstacle, so a fast move can
+    // not tunnel through a wall
+    if (d > 0) {
+        for (int i = (int)ceilf(hi[axis] + 0.5f - EPSILON);
+            i - 0.5f < hi[axis] + d; i++)
+        {
+            if (blocked(context, lo, hi, axis, i)) {
+                return i - 0.5f - hi[axis];
+            }
+        }
+    }
+    if (d < 0) {
+        for (int i = (int)floorf(lo[axis] - 0.5f + EPSILON);
+            i + 0.5f > lo[axis] + d; i--)
+        {
+            if (blocked(context, lo, hi, axis, i)) {
+                return i + 0.5f - lo[axis];
+            }
+        }
+    }
+    return d;
+}
+
+void collide_invalidate(CollideWindow *window) {
+    window->valid = 0;
+}
+
+void collide_invalidate_chunk(CollideWindow *window, int p, int q) {
+    // only a chunk the window overlaps makes it stale
+    int x = p * CHUNK_SIZE;
+    int z = q * CHUNK_SIZE;
+    if (x < window->x + COLLIDE_SIZE && x + CHUNK_SIZE > window->x &&
+        z < window->z + COLLIDE_SIZE && z + CHUNK_SIZE > window->z)
+    {
+        window->valid = 0;
+    }
+}
+
+void collide_set_block(CollideWindow *window, int x, int y, int z, int w) {
+    int dx = x - window->x;
+    int dy = y - window->y;
+    int dz = z - window->z;
+    if (window->valid &&
+        dx >= 0 && dy >= 0 && dz >= 0 &&
+        dx < COLLIDE_SIZE && dy < COLLIDE_SIZE && dz < COLLIDE_SIZE)
+    {
+        window->solid[dx][dy][dz] = is_obstacle(w);
+    }
+}
+
+int collide_move(
+    CollideWindow *window, collide_chunk_func func, void *arg, int height,
+    float *x, float *y, float *z, float dx, float dy, float dz)
+{
+    // the player box is 0.5 wide and extends from height - 0.75 below the
+    // eye to 0.25 above it, each axis is swept separately, vertical first
+    static const int order[3] = {1, 0, 2};
+    static const int flags[3] = {COLLIDE_X, COLLIDE_Y, COLLIDE_Z};
+    Context context = {window, func, arg};
+    float position[3] = {*x, *y, *z};
+    float lo[3] = {*x - PAD, *y - height + 0.75f, *z - PAD};
+    float hi[3] = {*x + PAD, *y + PAD, *z + PAD};
+    float motion[3] = {dx, dy, dz};
+    int result = 0;
+    for (int i = 0; i < 3; i++) {
+        int axis = order[i];
+        float d = sweep(&context, lo, hi, axis, motion[axis]);
+        if (d != motion[axis]) {
+            result |= flags[axis];
+        }
+        position[axis] += d;
+        lo[axis] += d;
+        hi[axis] += d;
+    }
+    *x = position[0];
+    *y = position[1];
+    *z = position[2];
+    return result;
+}
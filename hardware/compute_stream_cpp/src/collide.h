@@ -0,0 +1,32 @@
+#ifndef _collide_h_
+#define _collide_h_
+
+#include "map.h"
+
+#define COLLIDE_X 1
+#define COLLIDE_Y 2
+#define COLLIDE_Z 4
+
+#define COLLIDE_SIZE 24
+
+// returns the block map of chunk (p, q) or 0 if it is not loaded
+typedef Map *(*collide_chunk_func)(int p, int q, void *arg);
+
+// obstacle flags for a cube of blocks around the player, refilled only
+// when the player leaves it or the world changes
+typedef struct {
+    int valid;
+    int x;
+    int y;
+    int z;
+    unsigned char solid[COLLIDE_SIZE][COLLIDE_SIZE][COLLIDE_SIZE];
+} CollideWindow;
+
+void collide_invalidate(CollideWindow *window);
+void collide_invalidate_chunk(CollideWindow *window, int p, int q);
+void collide_set_block(CollideWindow *window, int x, int y, int z, int w);
+int collide_move(
+    CollideWindow *window, collide_chunk_func func, void *arg, int height,
+    float *x, float *y, float *z, float dx, float dy, float dz);
+
+#endif
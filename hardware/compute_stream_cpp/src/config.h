@@ -10,21 +10,28 @@
 #define SCROLL_THRESHOLD 0.1
 #define MAX_MESSAGES 4
 #define DB_PATH "craft.db"
+#define CALIBRATION_PATH "calibration.txt"
 #define USE_CACHE 1
 #define DAY_LENGTH 600
 #define INVERT_MOUSE 0
+#define USE_BINARY_PROTOCOL 1
 
 // rendering options
 #define SHOW_LIGHTS 1
 #define SHOW_PLANTS 1
 #define SHOW_CLOUDS 1
 #define SHOW_TREES 1
+#define OCCLUSION_CULLING 1
 #define SHOW_ITEM 1
 #define SHOW_CROSSHAIRS 1
 #define SHOW_WIREFRAME 1
 #define SHOW_INFO_TEXT 1
 #define SHOW_CHAT_TEXT 1
 #define SHOW_PLAYER_NAMES 1
+#define FUSED_OUTPUT 1
+// computes the video phase mask on the cpu, only worth it for mostly
+// static depth, and it samples depth nearest where the shader is bilinear
+#define CPU_PHASE_MASK 0
 
 // key bindings
 #define CRAFT_KEY_FORWARD 'W'
@@ -47,8 +54,16 @@
 #define CREATE_CHUNK_RADIUS 10
 #define RENDER_CHUNK_RADIUS 10
 #define RENDER_SIGN_RADIUS 4
+#define LOD1_CHUNK_RADIUS 3
+#define LOD2_CHUNK_RADIUS 6
 #define DELETE_CHUNK_RADIUS 14
 #define CHUNK_SIZE 32
 #define COMMIT_INTERVAL 5
+#define CHUNK_REQUEST_WINDOW 16
+#define CHUNK_REQUEST_TIMEOUT 10
+#define WORLD_CACHE_BYTES (32 * 1024 * 1024)
+#define ARENA_PAGE_SIZE (64 * 1024 * 1024)
+#define CAPTURE_SLOTS 12
+#define CAPTURE_WRITERS 2
 
 #endif
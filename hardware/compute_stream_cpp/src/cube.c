@@ -213,6 +213,26 @@ void make_cube_wireframe(float *data, float x, float y, float z, float n) {
     }
 }
 
+void make_box(
+    float *data, float x0, float y0, float z0, float x1, float y1, float z1)
+{
+    static const int indices[36] = {
+        0, 1, 3, 0, 3, 2,
+        4, 6, 7, 4, 7, 5,
+        2, 3, 7, 2, 7, 6,
+        0, 4, 5, 0, 5, 1,
+        0, 2, 6, 0, 6, 4,
+        1, 5, 7, 1, 7, 3
+    };
+    float *d = data;
+    for (int i = 0; i < 36; i++) {
+        int j = indices[i];
+        *(d++) = j & 4 ? x1 : x0;
+        *(d++) = j & 2 ? y1 : y0;
+        *(d++) = j & 1 ? z1 : z0;
+    }
+}
+
 void make_character(
     float *data,
     float x, float y, float n, float m, char c)
@@ -23,6 +23,9 @@ void make_player(
 void make_cube_wireframe(
     float *data, float x, float y, float z, float n);
 
+void make_box(
+    float *data, float x0, float y0, float z0, float x1, float y1, float z1);
+
 void make_character(
     float *data,
     float x, float y, float n, float m, char c);
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "cull.h"
+
+// columns are first tested in square groups of GROUP x GROUP
+#define GROUP 4
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CULL_AVX 1
+#include <immintrin.h>
+#endif
+
+void cull_boxes_free(CullBoxes *boxes) {
+    free(boxes->ids);
+    free(boxes->minx);
+    free(boxes->miny);
+    free(boxes->minz);
+    free(boxes->maxx);
+    free(boxes->maxy);
+    free(boxes->maxz);
+    free(boxes->visible);
+    memset(boxes, 0, sizeof(CullBoxes));
+}
+
+void cull_boxes_clear(CullBoxes *boxes) {
+    boxes->count = 0;
+}
+
+static void cull_boxes_grow(CullBoxes *boxes) {
+    int n = boxes->capacity ? boxes->capacity * 2 : 256;
+    boxes->ids = realloc(boxes->ids, sizeof(int) * n);
+    boxes->minx = realloc(boxes->minx, sizeof(float) * n);
+    boxes->miny = realloc(boxes->miny, sizeof(float) * n);
+    boxes->minz = realloc(boxes->minz, sizeof(float) * n);
+    boxes->maxx = realloc(boxes->maxx, sizeof(float) * n);
+    boxes->maxy = realloc(boxes->maxy, sizeof(float) * n);
+    boxes->maxz = realloc(boxes->maxz, sizeof(float) * n);
+    boxes->visible = realloc(boxes->visible, n);
+    boxes->capacity = n;
+}
+
+void cull_boxes_add(
+    CullBoxes *boxes, int id, float minx, float miny, float minz,
+    float maxx, float maxy, float maxz)
+{
+    if (boxes->count == boxes->capacity) {
+        cull_boxes_grow(boxes);
+    }
+    int i = boxes->count++;
+    boxes->ids[i] = id;
+    boxes->minx[i] = minx;
+    boxes->miny[i] = miny;
+    boxes->minz[i] = minz;
+    boxes->maxx[i] = maxx;
+    boxes->maxy[i] = maxy;
+    boxes->maxz[i] = maxz;
+}
+
+void cull_boxes_add_chunk(
+    CullBoxes *boxes, int id, int p, int q, int miny, int maxy)
+{
+    int x = p * CHUNK_SIZE - 1;
+    int z = q * CHUNK_SIZE - 1;
+    int d = CHUNK_SIZE + 1;
+    cull_boxes_add(boxes, id, x, miny, z, x + d, maxy, z + d);
+}
+
+// a box is outside a plane when the corner furthest along the plane
+// normal (the p-vertex) is behind it
+
+static void test_scalar(
+    CullBoxes *boxes, float planes[6][4], int count, int start)
+{
+    for (int i = start; i < boxes->count; i++) {
+        int visible = 1;
+        for (int j = 0; j < count && visible; j++) {
+            float *plane = planes[j];
+            float x = plane[0] < 0 ? boxes->minx[i] : boxes->maxx[i];
+            float y = plane[1] < 0 ? boxes->miny[i] : boxes->maxy[i];
+            float z = plane[2] < 0 ? boxes->minz[i] : boxes->maxz[i];
+            float d = plane[0] * x + plane[1] * y + plane[2] * z + plane[3];
+            visible = d >= 0;
+        }
+        boxes->visible[i] = visible;
+    }
+}
+
+#if CULL_AVX
+
+#define AVX __attribute__((target("avx")))
+
+AVX static void test_avx(CullBoxes *boxes, float planes[6][4], int count) {
+    __m256 a[6], b[6], c[6], d[6];
+    const float *xs[6], *ys[6], *zs[6];
+    for (int j = 0; j < count; j++) {
+        float *plane = planes[j];
+        a[j] = _mm256_set1_ps(plane[0]);
+        b[j] = _mm256_set1_ps(plane[1]);
+        c[j] = _mm256_set1_ps(plane[2]);
+        d[j] = _mm256_set1_ps(plane[3]);
+        xs[j] = plane[0] < 0 ? boxes->minx : boxes->maxx;
+        ys[j] = plane[1] < 0 ? boxes->miny : boxes->maxy;
+        zs[j] = plane[2] < 0 ? boxes->minz : boxes->maxz;
+    }
+    __m256 zero = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= boxes->count; i += 8) {
+        __m256 out = zero;
+        for (int j = 0; j < count; j++) {
+            __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(a[j], _mm256_loadu_ps(xs[j] + i)),
+                _mm256_mul_ps(b[j], _mm256_loadu_ps(ys[j] + i))),
+                _mm256_mul_ps(c[j], _mm256_loadu_ps(zs[j] + i))), d[j]);
+            out = _mm256_or_ps(out, _mm256_cmp_ps(dist, zero, _CMP_NGE_UQ));
+        }
+        int mask = _mm256_movemask_ps(out);
+        for (int k = 0; k < 8; k++) {
+            boxes->visible[i + k] = !((mask >> k) & 1);
+        }
+    }
+    test_scalar(boxes, planes, count, i);
+}
+
+static int cull_avx = -1;
+
+static int has_avx() {
+    if (cull_avx < 0) {
+        __builtin_cpu_init();
+        cull_avx = __builtin_cpu_supports("avx") ? 1 : 0;
+    }
+    return cull_avx;
+}
+
+#endif
+
+void cull_boxes_test(CullBoxes *boxes, float planes[6][4], int count) {
+#if CULL_AVX
+    if (has_avx()) {
+        test_avx(boxes, planes, count);
+        return;
+    }
+#endif
+    test_scalar(boxes, planes, count, 0);
+}
+
+void cull_grid_free(CullGrid *grid) {
+    free(grid->visible);
+    cull_boxes_free(&grid->groups);
+    cull_boxes_free(&grid->columns);
+    memset(grid, 0, sizeof(CullGrid));
+}
+
+void cull_grid_update(
+    CullGrid *grid, float planes[6][4], int count, int p, int q, int radius)
+{
+    int size = radius * 2 + 1;
+    if (size != grid->size) {
+        grid->visible = realloc(grid->visible, size * size);
+        grid->size = size;
+    }
+    grid->p = p;
+    grid->q = q;
+    grid->radius = radius;
+    memset(grid->visible, 0, size * size);
+    int p0 = p - radius;
+    int q0 = q - radius;
+    CullBoxes *groups = &grid->groups;
+    CullBoxes *columns = &grid->columns;
+    cull_boxes_clear(groups);
+    for (int i = 0; i < size; i += GROUP) {
+        for (int j = 0; j < size; j += GROUP) {
+            int n = size - i < GROUP ? size - i : GROUP;
+            int m = size - j < GROUP ? size - j : GROUP;
+            cull_boxes_add(groups, i * size + j,
+                (p0 + i) * CHUNK_SIZE - 1, 0, (q0 + j) * CHUNK_SIZE - 1,
+                (p0 + i + n) * CHUNK_SIZE, 256, (q0 + j + m) * CHUNK_SIZE);
+        }
+    }
+    cull_boxes_test(groups, planes, count);
+    cull_boxes_clear(columns);
+    for (int k = 0; k < groups->count; k++) {
+        if (!groups->visible[k]) {
+            continue;
+        }
+        int i0 = groups->ids[k] / size;
+        int j0 = groups->ids[k] % size;
+        for (int i = i0; i < i0 + GROUP && i < size; i++) {
+            for (int j = j0; j < j0 + GROUP && j < size; j++) {
+                cull_boxes_add_chunk(
+                    columns, i * size + j, p0 + i, q0 + j, 0, 256);
+            }
+        }
+    }
+    cull_boxes_test(columns, planes, count);
+    for (int k = 0; k < columns->count; k++) {
+        grid->visible[columns->ids[k]] = columns->visible[k];
+    }
+}
+
+int cull_grid_visible(CullGrid *grid, int p, int q) {
+    int i = p - grid->p + grid->radius;
+    int j = q - grid->q + grid->radius;
+    if (i < 0 || j < 0 || i >= grid->size || j >= grid->size) {
+        return 0;
+    }
+    return grid->visible[i * grid->size + j];
+}
@@ -0,0 +1,43 @@
+#ifndef _cull_h_
+#define _cull_h_
+
+// axis aligned boxes in structure of arrays form, tested against the
+// frustum planes eight at a time
+typedef struct {
+    int count;
+    int capacity;
+    int *ids;
+    float *minx;
+    float *miny;
+    float *minz;
+    float *maxx;
+    float *maxy;
+    float *maxz;
+    unsigned char *visible;
+} CullBoxes;
+
+// visibility of every full height chunk column within radius of (p, q)
+typedef struct {
+    int p;
+    int q;
+    int radius;
+    int size;
+    unsigned char *visible;
+    CullBoxes groups;
+    CullBoxes columns;
+} CullGrid;
+
+void cull_boxes_free(CullBoxes *boxes);
+void cull_boxes_clear(CullBoxes *boxes);
+void cull_boxes_add(
+    CullBoxes *boxes, int id, float minx, float miny, float minz,
+    float maxx, float maxy, float maxz);
+void cull_boxes_add_chunk(
+    CullBoxes *boxes, int id, int p, int q, int miny, int maxy);
+void cull_boxes_test(CullBoxes *boxes, float planes[6][4], int count);
+void cull_grid_free(CullGrid *grid);
+void cull_grid_update(
+    CullGrid *grid, float planes[6][4], int count, int p, int q, int radius);
+int cull_grid_visible(CullGrid *grid, int p, int q);
+
+#endif
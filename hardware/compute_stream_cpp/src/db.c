@@ -19,6 +19,8 @@ static sqlite3_stmt *get_key_stmt;
 static sqlite3_stmt *set_key_stmt;
 
 static Ring ring;
+static Ring batch;
+static int batching = 0;
 static thrd_t thrd;
 static mtx_t mtx;
 static cnd_t cnd;
@@ -316,6 +318,10 @@ void db_insert_block(int p, int q, int x, int y, int z, int w) {
     if (!db_enabled) {
         return;
     }
+    if (batching) {
+        ring_put_block(&batch, p, q, x, y, z, w);
+        return;
+    }
     mtx_lock(&mtx);
     ring_put_block(&ring, p, q, x, y, z, w);
     cnd_signal(&cnd);
@@ -337,6 +343,10 @@ void db_insert_light(int p, int q, int x, int y, int z, int w) {
     if (!db_enabled) {
         return;
     }
+    if (batching) {
+        ring_put_light(&batch, p, q, x, y, z, w);
+        return;
+    }
     mtx_lock(&mtx);
     ring_put_light(&ring, p, q, x, y, z, w);
     cnd_signal(&cnd);
@@ -472,6 +482,10 @@ void db_set_key(int p, int q, int key) {
     if (!db_enabled) {
         return;
     }
+    if (batching) {
+        ring_put_key(&batch, p, q, key);
+        return;
+    }
     mtx_lock(&mtx);
     ring_put_key(&ring, p, q, key);
     cnd_signal(&cnd);
@@ -486,11 +500,38 @@ void _db_set_key(int p, int q, int key) {
     sqlite3_step(set_key_stmt);
 }
 
+// writes made between begin and end are queued locally and handed to
+// the worker under a single lock
+void db_begin_batch() {
+    if (!db_enabled) {
+        return;
+    }
+    batching = 1;
+}
+
+void db_end_batch() {
+    if (!db_enabled || !batching) {
+        return;
+    }
+    batching = 0;
+    if (ring_empty(&batch)) {
+        return;
+    }
+    RingEntry e;
+    mtx_lock(&mtx);
+    while (ring_get(&batch, &e)) {
+        ring_put(&ring, &e);
+    }
+    cnd_signal(&cnd);
+    mtx_unlock(&mtx);
+}
+
 void db_worker_start(char *path) {
     if (!db_enabled) {
         return;
     }
     ring_alloc(&ring, 1024);
+    ring_alloc(&batch, 1024);
     mtx_init(&mtx, mtx_plain);
     mtx_init(&load_mtx, mtx_plain);
     cnd_init(&cnd);
@@ -510,6 +551,7 @@ void db_worker_stop() {
     mtx_destroy(&load_mtx);
     mtx_destroy(&mtx);
     ring_free(&ring);
+    ring_free(&batch);
 }
 
 int db_worker_run(void *arg) {
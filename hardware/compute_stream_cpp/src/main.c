@@ -8,19 +8,27 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "arena.h"
 #include "auth.h"
+#include "calib.h"
+#include "capture.h"
 #include "client.h"
+#include "collide.h"
 #include "config.h"
 #include "cube.h"
+#include "cull.h"
 #include "db.h"
 #include "item.h"
 #include "map.h"
 #include "matrix.h"
 #include "noise.h"
+#include "phase.h"
+#include "ray.h"
 #include "sign.h"
 #include "tinycthread.h"
 #include "util.h"
 #include "world.h"
+#include "world_cache.h"
 
 #include <windows.h>
 
@@ -38,6 +46,7 @@ void usleep(__int64 usec)
 }
 
 #define MAX_CHUNKS 8192
+#define LODS 3
 #define MAX_PLAYERS 128
 #define WORKERS 4
 #define MAX_TEXT_LENGTH 256
@@ -56,22 +65,44 @@ void usleep(__int64 usec)
 #define WORKER_BUSY 1
 #define WORKER_DONE 2
 
+#define REQUEST_NONE 0
+#define REQUEST_QUEUED 1
+#define REQUEST_SENT 2
+
 #define WIDTH  2560
 #define HEIGHT 2560
 
+#define SLM_WIDTH 4000
+#define SLM_HEIGHT 2464
+#define OLED_SIZE 2560
+#define OUTPUT_WIDTH MAX(SLM_WIDTH, OLED_SIZE)
+#define OUTPUT_HEIGHT MAX(SLM_HEIGHT, OLED_SIZE)
+
+// top obstacle and top opaque block of every column in a chunk, or -1
+typedef struct {
+    short obstacle[CHUNK_SIZE * CHUNK_SIZE];
+    short opaque[CHUNK_SIZE * CHUNK_SIZE];
+} HeightMap;
+
 typedef struct {
     Map map;
     Map lights;
     SignList signs;
+    HeightMap *heights;
     int p;
     int q;
-    int faces;
+    int faces[LODS];
     int sign_faces;
     int dirty;
     int miny;
     int maxy;
-    GLuint buffer;
+    int request;
+    double request_time;
+    ArenaBlock blocks[LODS];
     GLuint sign_buffer;
+    GLuint query;
+    int query_pending;
+    int occluded;
 } Chunk;
 
 typedef struct {
@@ -80,10 +111,11 @@ typedef struct {
     int load;
     Map *block_maps[3][3];
     Map *light_maps[3][3];
+    HeightMap *height_maps[3][3];
     int miny;
     int maxy;
-    int faces;
-    GLfloat *data;
+    int faces[LODS];
+    GLfloat *data[LODS];
 } WorkerItem;
 
 typedef struct {
@@ -141,10 +173,22 @@ typedef struct {
     Worker workers[WORKERS];
     Chunk chunks[MAX_CHUNKS];
     int chunk_count;
+    int edit_depth;
+    Chunk *burst_chunk;
+    Chunk *burst_dirty[MAX_CHUNKS];
+    int burst_dirty_count;
+    CullGrid cull;
+    CullBoxes chunk_boxes;
+    CollideWindow collide;
+    PhaseMask phase;
     int create_radius;
     int render_radius;
     int delete_radius;
     int sign_radius;
+    int occlusion;
+    int drawn_faces;
+    int occluded_faces;
+    int occluded_chunks;
     Player players[MAX_PLAYERS];
     int player_count;
     int typing;
@@ -166,10 +210,13 @@ typedef struct {
     char db_path[MAX_PATH_LENGTH];
     char server_addr[MAX_ADDR_LENGTH];
     int server_port;
+    int reconnecting;
     int day_length;
     int time_changed;
     int requested_vid;
     int save_img;
+    char calibration_path[MAX_PATH_LENGTH];
+    int calibration_changed;
     Block block0;
     Block block1;
     Block copy0;
@@ -395,8 +442,8 @@ void draw_lines(Attrib *attrib, GLuint buffer, int components, int count) {
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void draw_chunk(Attrib *attrib, Chunk *chunk) {
-    draw_triangles_3d_ao(attrib, chunk->buffer, chunk->faces * 6);
+void draw_chunk(Chunk *chunk, int lod) {
+    arena_draw(chunk->blocks + lod, chunk->faces[lod] * 6);
 }
 
 void draw_item(Attrib *attrib, GLuint buffer, int count) {
@@ -610,93 +657,112 @@ int chunk_visible(float planes[6][4], int p, int q, int miny, int maxy) {
     return 1;
 }
 
+void build_heights(HeightMap *heights, Map *map, int p, int q) {
+    for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++) {
+        heights->obstacle[i] = -1;
+        heights->opaque[i] = -1;
+    }
+    int x0 = p * CHUNK_SIZE;
+    int z0 = q * CHUNK_SIZE;
+    MAP_FOR_EACH(map, ex, ey, ez, ew) {
+        int x = ex - x0;
+        int z = ez - z0;
+        if (x < 0 || z < 0 || x >= CHUNK_SIZE || z >= CHUNK_SIZE) {
+            continue;
+        }
+        int i = x * CHUNK_SIZE + z;
+        if (is_obstacle(ew)) {
+            heights->obstacle[i] = MAX(heights->obstacle[i], ey);
+        }
+        if (!is_transparent(ew)) {
+            heights->opaque[i] = MAX(heights->opaque[i], ey);
+        }
+    } END_MAP_FOR_EACH;
+}
+
+void update_heights(Chunk *chunk, int x, int y, int z, int w) {
+    // called after the block map is updated, a column only needs a scan
+    // when its top block is removed
+    int dx = x - chunk->p * CHUNK_SIZE;
+    int dz = z - chunk->q * CHUNK_SIZE;
+    if (dx < 0 || dz < 0 || dx >= CHUNK_SIZE || dz >= CHUNK_SIZE) {
+        return;
+    }
+    Map *map = &chunk->map;
+    int i = dx * CHUNK_SIZE + dz;
+    short *obstacle = chunk->heights->obstacle + i;
+    short *opaque = chunk->heights->opaque + i;
+    if (is_obstacle(w)) {
+        *obstacle = MAX(*obstacle, y);
+    }
+    else if (y == *obstacle) {
+        int h = y - 1;
+        while (h >= 0 && !is_obstacle(map_get(map, x, h, z))) {
+            h--;
+        }
+        *obstacle = h;
+    }
+    if (!is_transparent(w)) {
+        *opaque = MAX(*opaque, y);
+    }
+    else if (y == *opaque) {
+        int h = y - 1;
+        while (h >= 0 && is_transparent(map_get(map, x, h, z))) {
+            h--;
+        }
+        *opaque = h;
+    }
+}
+
 int highest_block(float x, float z) {
-    int result = -1;
-    int nx = roundf(x);
-    int nz = roundf(z);
     int p = chunked(x);
     int q = chunked(z);
     Chunk *chunk = find_chunk(p, q);
-    if (chunk) {
-        Map *map = &chunk->map;
-        MAP_FOR_EACH(map, ex, ey, ez, ew) {
-            if (is_obstacle(ew) && ex == nx && ez == nz) {
-                result = MAX(result, ey);
-            }
-        } END_MAP_FOR_EACH;
+    if (!chunk) {
+        return -1;
     }
-    return result;
+    int dx = (int)roundf(x) - p * CHUNK_SIZE;
+    int dz = (int)roundf(z) - q * CHUNK_SIZE;
+    return chunk->heights->obstacle[dx * CHUNK_SIZE + dz];
 }
 
-int _hit_test(
-    Map *map, float max_distance, int previous,
-    float x, float y, float z,
-    float vx, float vy, float vz,
-    int *hx, int *hy, int *hz)
-{
-    int m = 32;
-    int px = 0;
-    int py = 0;
-    int pz = 0;
-    for (int i = 0; i < max_distance * m; i++) {
-        int nx = roundf(x);
-        int ny = roundf(y);
-        int nz = roundf(z);
-        if (nx != px || ny != py || nz != pz) {
-            int hw = map_get(map, nx, ny, nz);
-            if (hw > 0) {
-                if (previous) {
-                    *hx = px; *hy = py; *hz = pz;
-                }
-                else {
-                    *hx = nx; *hy = ny; *hz = nz;
-                }
-                return hw;
-            }
-            px = nx; py = ny; pz = nz;
-        }
-        x += vx / m; y += vy / m; z += vz / m;
-    }
-    return 0;
+Map *chunk_map(int p, int q, void *arg) {
+    Chunk *chunk = find_chunk(p, q);
+    return chunk ? &chunk->map : 0;
+}
+
+int sight_hit(float x, float y, float z, float rx, float ry, RayHit *hit) {
+    Ray ray = {x, y, z, 0, 0, 0, 8};
+    get_sight_vector(rx, ry, &ray.vx, &ray.vy, &ray.vz);
+    return ray_cast(&ray, chunk_map, 0, hit);
 }
 
 int hit_test(
     int previous, float x, float y, float z, float rx, float ry,
     int *bx, int *by, int *bz)
 {
-    int result = 0;
-    float best = 0;
-    int p = chunked(x);
-    int q = chunked(z);
-    float vx, vy, vz;
-    get_sight_vector(rx, ry, &vx, &vy, &vz);
-    for (int i = 0; i < g->chunk_count; i++) {
-        Chunk *chunk = g->chunks + i;
-        if (chunk_distance(chunk, p, q) > 1) {
-            continue;
-        }
-        int hx, hy, hz;
-        int hw = _hit_test(&chunk->map, 8, previous,
-            x, y, z, vx, vy, vz, &hx, &hy, &hz);
-        if (hw > 0) {
-            float d = sqrtf(
-                powf(hx - x, 2) + powf(hy - y, 2) + powf(hz - z, 2));
-            if (best == 0 || d < best) {
-                best = d;
-                *bx = hx; *by = hy; *bz = hz;
-                result = hw;
-            }
-        }
+    RayHit hit;
+    if (!sight_hit(x, y, z, rx, ry, &hit)) {
+        return 0;
     }
-    return result;
+    if (previous) {
+        *bx = hit.px; *by = hit.py; *bz = hit.pz;
+    }
+    else {
+        *bx = hit.x; *by = hit.y; *bz = hit.z;
+    }
+    return hit.w;
 }
 
 int hit_test_face(Player *player, int *x, int *y, int *z, int *face) {
     State *s = &player->state;
-    int w = hit_test(0, s->x, s->y, s->z, s->rx, s->ry, x, y, z);
-    if (is_obstacle(w)) {
-        int hx, hy, hz;
-        hit_test(1, s->x, s->y, s->z, s->rx, s->ry, &hx, &hy, &hz);
+    RayHit hit;
+    sight_hit(s->x, s->y, s->z, s->rx, s->ry, &hit);
+    if (is_obstacle(hit.w)) {
+        int hx = hit.px;
+        int hy = hit.py;
+        int hz = hit.pz;
+        *x = hit.x; *y = hit.y; *z = hit.z;
         int dx = hx - *x;
         int dy = hy - *y;
         int dz = hz - *z;
@@ -724,47 +790,6 @@ int hit_test_face(Player *player, int *x, int *y, int *z, int *face) {
     return 0;
 }
 
-int collide(int height, float *x, float *y, float *z) {
-    int result = 0;
-    int p = chunked(*x);
-    int q = chunked(*z);
-    Chunk *chunk = find_chunk(p, q);
-    if (!chunk) {
-        return result;
-    }
-    Map *map = &chunk->map;
-    int nx = roundf(*x);
-    int ny = roundf(*y);
-    int nz = roundf(*z);
-    float px = *x - nx;
-    float py = *y - ny;
-    float pz = *z - nz;
-    float pad = 0.25;
-    for (int dy = 0; dy < height; dy++) {
-        if (px < -pad && is_obstacle(map_get(map, nx - 1, ny - dy, nz))) {
-            *x = nx - pad;
-        }
-        if (px > pad && is_obstacle(map_get(map, nx + 1, ny - dy, nz))) {
-            *x = nx + pad;
-        }
-        if (py < -pad && is_obstacle(map_get(map, nx, ny - dy - 1, nz))) {
-            *y = ny - pad;
-            result = 1;
-        }
-        if (py > pad && is_obstacle(map_get(map, nx, ny - dy + 1, nz))) {
-            *y = ny + pad;
-            result = 1;
-        }
-        if (pz < -pad && is_obstacle(map_get(map, nx, ny - dy, nz - 1))) {
-            *z = nz - pad;
-        }
-        if (pz > pad && is_obstacle(map_get(map, nx, ny - dy, nz + 1))) {
-            *z = nz + pad;
-        }
-    }
-    return result;
-}
-
 int player_intersects_block(
     int height,
     float x, float y, float z,
@@ -983,6 +1008,154 @@ void light_fill(
     light_fill(opaque, light, x, y, z + 1, w, 0);
 }
 
+int border_filled(
+    char *opaque, int x0, int y0, int z0, int sx, int sy, int sz)
+{
+    // the blocks of a neighboring chunk in the region only hide a face
+    // when they are filled at every level of detail the neighbor may be
+    // drawn at, opaque blocks stand in for its lod cells
+    for (int lod = 0; lod < LODS; lod++) {
+        int k = 1 << lod;
+        for (int cx = x0 - (x0 - 1) % k; cx < x0 + sx; cx += k) {
+            for (int cy = y0 - (y0 - 1) % k; cy < y0 + sy; cy += k) {
+                for (int cz = z0 - (z0 - 1) % k; cz < z0 + sz; cz += k) {
+                    int count = 0;
+                    for (int x = cx; x < cx + k; x++) {
+                        for (int y = cy; y < cy + k; y++) {
+                            for (int z = cz; z < cz + k; z++) {
+                                count += opaque[XYZ(x, y, z)];
+                            }
+                        }
+                    }
+                    if (count * 2 < k * k * k) {
+                        return 0;
+                    }
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+int block_hidden(char *opaque, int x, int y, int z) {
+    if (x == XZ_LO || x == XZ_HI || z == XZ_LO || z == XZ_HI) {
+        return border_filled(opaque, x, y, z, 1, 1, 1);
+    }
+    return opaque[XYZ(x, y, z)];
+}
+
+#define CELL(x, y, z) (((y) * n + (x)) * n + (z))
+
+int lod_filled(
+    char *opaque, unsigned char *count, int k, int cx, int cy, int cz)
+{
+    int n = CHUNK_SIZE / k;
+    if (cy >= 256 / k) {
+        return 0;
+    }
+    if (cx >= 0 && cx < n && cz >= 0 && cz < n) {
+        return count[CELL(cx, cy, cz)] * 2 >= k * k * k;
+    }
+    // only the neighbor's blocks that touch the chunk border matter
+    int x0 = cx < 0 ? XZ_LO : cx >= n ? XZ_HI : XZ_LO + 1 + cx * k;
+    int z0 = cz < 0 ? XZ_LO : cz >= n ? XZ_HI : XZ_LO + 1 + cz * k;
+    int sx = cx < 0 || cx >= n ? 1 : k;
+    int sz = cz < 0 || cz >= n ? 1 : k;
+    return border_filled(opaque, x0, cy * k + 1, z0, sx, k, sz);
+}
+
+void compute_lod(
+    WorkerItem *item, char *opaque, int lod, int *miny, int *maxy)
+{
+    // cells of k x k x k blocks are filled when at least half of their
+    // blocks are, and take the type of their highest block
+    int k = 1 << lod;
+    int n = CHUNK_SIZE / k;
+    int size = n * n * (256 / k);
+    unsigned char *count = calloc(size, sizeof(unsigned char));
+    unsigned char *top = calloc(size, sizeof(unsigned char));
+    char *type = calloc(size, sizeof(char));
+    unsigned char *mask = calloc(size, sizeof(unsigned char));
+    int px = item->p * CHUNK_SIZE;
+    int pz = item->q * CHUNK_SIZE;
+    Map *map = item->block_maps[1][1];
+    MAP_FOR_EACH(map, ex, ey, ez, ew) {
+        int x = ex - px;
+        int z = ez - pz;
+        if (ew <= 0 || is_plant(ew) || ey < 0 || ey >= 256) {
+            continue;
+        }
+        if (x < 0 || z < 0 || x >= CHUNK_SIZE || z >= CHUNK_SIZE) {
+            continue;
+        }
+        int i = CELL(x / k, ey / k, z / k);
+        count[i]++;
+        if (ey % k + 1 >= top[i]) {
+            top[i] = ey % k + 1;
+            type[i] = ew;
+        }
+    } END_MAP_FOR_EACH;
+    int faces = 0;
+    for (int cy = 0; cy < 256 / k; cy++) {
+        for (int cx = 0; cx < n; cx++) {
+            for (int cz = 0; cz < n; cz++) {
+                int i = CELL(cx, cy, cz);
+                if (count[i] * 2 < k * k * k) {
+                    continue;
+                }
+                int f1 = !lod_filled(opaque, count, k, cx - 1, cy, cz);
+                int f2 = !lod_filled(opaque, count, k, cx + 1, cy, cz);
+                int f3 = !lod_filled(opaque, count, k, cx, cy + 1, cz);
+                int f4 = cy > 0 &&
+                    !lod_filled(opaque, count, k, cx, cy - 1, cz);
+                int f5 = !lod_filled(opaque, count, k, cx, cy, cz - 1);
+                int f6 = !lod_filled(opaque, count, k, cx, cy, cz + 1);
+                int total = f1 + f2 + f3 + f4 + f5 + f6;
+                if (total == 0) {
+                    continue;
+                }
+                mask[i] = f1 | f2 << 1 | f3 << 2 |
+                    f4 << 3 | f5 << 4 | f6 << 5;
+                *miny = MIN(*miny, cy * k);
+                *maxy = MAX(*maxy, cy * k + k - 1);
+                faces += total;
+            }
+        }
+    }
+    GLfloat *data = malloc_faces(10, faces);
+    float ao[6][4] = {{0}};
+    float light[6][4] = {{0}};
+    int offset = 0;
+    for (int cy = 0; cy < 256 / k; cy++) {
+        for (int cx = 0; cx < n; cx++) {
+            for (int cz = 0; cz < n; cz++) {
+                int i = CELL(cx, cy, cz);
+                int m = mask[i];
+                if (!m) {
+                    continue;
+                }
+                make_cube(
+                    data + offset, ao, light,
+                    m & 1, (m >> 1) & 1, (m >> 2) & 1,
+                    (m >> 3) & 1, (m >> 4) & 1, (m >> 5) & 1,
+                    px + cx * k + (k - 1) * 0.5f, cy * k + (k - 1) * 0.5f,
+                    pz + cz * k + (k - 1) * 0.5f, k * 0.5f, type[i]);
+                for (int j = 0; j < 6; j++) {
+                    offset += ((m >> j) & 1) * 60;
+                }
+            }
+        }
+    }
+    free(count);
+    free(top);
+    free(type);
+    free(mask);
+    item->faces[lod] = faces;
+    item->data[lod] = data;
+}
+
+#undef CELL
+
 void compute_chunk(WorkerItem *item) {
     char *opaque = (char *)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
     char *light = (char *)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
@@ -1026,13 +1199,33 @@ void compute_chunk(WorkerItem *item) {
                 }
                 // END TODO
                 opaque[XYZ(x, y, z)] = !is_transparent(w);
-                if (opaque[XYZ(x, y, z)]) {
+                // blocks a chunk owns are covered by its height map,
+                // negative border copies may belong to a missing chunk
+                if (w < 0 && opaque[XYZ(x, y, z)]) {
                     highest[XZ(x, z)] = MAX(highest[XZ(x, z)], y);
                 }
             } END_MAP_FOR_EACH;
         }
     }
 
+    // populate highest array from the height maps
+    for (int a = 0; a < 3; a++) {
+        for (int b = 0; b < 3; b++) {
+            HeightMap *heights = item->height_maps[a][b];
+            if (!heights) {
+                continue;
+            }
+            for (int dx = 0; dx < CHUNK_SIZE; dx++) {
+                for (int dz = 0; dz < CHUNK_SIZE; dz++) {
+                    int x = a * CHUNK_SIZE + dx + 1;
+                    int z = b * CHUNK_SIZE + dz + 1;
+                    int y = heights->opaque[dx * CHUNK_SIZE + dz] - oy;
+                    highest[XZ(x, z)] = MAX(highest[XZ(x, z)], y);
+                }
+            }
+        }
+    }
+
     // flood fill light intensities
     if (has_light) {
         for (int a = 0; a < 3; a++) {
@@ -1064,12 +1257,12 @@ void compute_chunk(WorkerItem *item) {
         int x = ex - ox;
         int y = ey - oy;
         int z = ez - oz;
-        int f1 = !opaque[XYZ(x - 1, y, z)];
-        int f2 = !opaque[XYZ(x + 1, y, z)];
+        int f1 = !block_hidden(opaque, x - 1, y, z);
+        int f2 = !block_hidden(opaque, x + 1, y, z);
         int f3 = !opaque[XYZ(x, y + 1, z)];
         int f4 = !opaque[XYZ(x, y - 1, z)] && (ey > 0);
-        int f5 = !opaque[XYZ(x, y, z - 1)];
-        int f6 = !opaque[XYZ(x, y, z + 1)];
+        int f5 = !block_hidden(opaque, x, y, z - 1);
+        int f6 = !block_hidden(opaque, x, y, z + 1);
         int total = f1 + f2 + f3 + f4 + f5 + f6;
         if (total == 0) {
             continue;
@@ -1092,12 +1285,12 @@ void compute_chunk(WorkerItem *item) {
         int x = ex - ox;
         int y = ey - oy;
         int z = ez - oz;
-        int f1 = !opaque[XYZ(x - 1, y, z)];
-        int f2 = !opaque[XYZ(x + 1, y, z)];
+        int f1 = !block_hidden(opaque, x - 1, y, z);
+        int f2 = !block_hidden(opaque, x + 1, y, z);
         int f3 = !opaque[XYZ(x, y + 1, z)];
         int f4 = !opaque[XYZ(x, y - 1, z)] && (ey > 0);
-        int f5 = !opaque[XYZ(x, y, z - 1)];
-        int f6 = !opaque[XYZ(x, y, z + 1)];
+        int f5 = !block_hidden(opaque, x, y, z - 1);
+        int f6 = !block_hidden(opaque, x, y, z + 1);
         int total = f1 + f2 + f3 + f4 + f5 + f6;
         if (total == 0) {
             continue;
@@ -1151,22 +1344,28 @@ void compute_chunk(WorkerItem *item) {
         offset += total * 60;
     } END_MAP_FOR_EACH;
 
+    item->faces[0] = faces;
+    item->data[0] = data;
+    for (int lod = 1; lod < LODS; lod++) {
+        compute_lod(item, opaque, lod, &miny, &maxy);
+    }
+
     free(opaque);
     free(light);
     free(highest);
 
     item->miny = miny;
     item->maxy = maxy;
-    item->faces = faces;
-    item->data = data;
 }
 
 void generate_chunk(Chunk *chunk, WorkerItem *item) {
     chunk->miny = item->miny;
     chunk->maxy = item->maxy;
-    chunk->faces = item->faces;
-    del_buffer(chunk->buffer);
-    chunk->buffer = gen_faces(10, item->faces, item->data);
+    for (int i = 0; i < LODS; i++) {
+        chunk->faces[i] = item->faces[i];
+        arena_upload(chunk->blocks + i, item->faces[i] * 6, item->data[i]);
+        free(item->data[i]);
+    }
     gen_sign_buffer(chunk);
 }
 
@@ -1184,10 +1383,12 @@ void gen_chunk_buffer(Chunk *chunk) {
             if (other) {
                 item->block_maps[dp + 1][dq + 1] = &other->map;
                 item->light_maps[dp + 1][dq + 1] = &other->lights;
+                item->height_maps[dp + 1][dq + 1] = other->heights;
             }
             else {
                 item->block_maps[dp + 1][dq + 1] = 0;
                 item->light_maps[dp + 1][dq + 1] = 0;
+                item->height_maps[dp + 1][dq + 1] = 0;
             }
         }
     }
@@ -1196,9 +1397,9 @@ void gen_chunk_buffer(Chunk *chunk) {
     chunk->dirty = 0;
 }
 
-void map_set_func(int x, int y, int z, int w, void *arg) {
+void map_set_func(int x, int y, int z, int n, int w, void *arg) {
     Map *map = (Map *)arg;
-    map_set(map, x, y, z, w);
+    map_set_column(map, x, y, z, n, w);
 }
 
 void load_chunk(WorkerItem *item) {
@@ -1206,23 +1407,40 @@ void load_chunk(WorkerItem *item) {
     int q = item->q;
     Map *block_map = item->block_maps[1][1];
     Map *light_map = item->light_maps[1][1];
-    create_world(p, q, map_set_func, block_map);
+    world_cache_create(p, q, map_set_func, block_map);
     db_load_blocks(block_map, p, q);
     db_load_lights(light_map, p, q);
+    build_heights(item->height_maps[1][1], block_map, p, q);
 }
 
 void request_chunk(int p, int q) {
-    int key = db_get_key(p, q);
-    client_chunk(p, q, key);
+    if (!get_client_enabled()) {
+        return;
+    }
+    Chunk *chunk = find_chunk(p, q);
+    if (chunk) {
+        chunk->request = REQUEST_QUEUED;
+    }
+}
+
+void chunk_request_done(int p, int q) {
+    Chunk *chunk = find_chunk(p, q);
+    if (chunk && chunk->request == REQUEST_SENT) {
+        chunk->request = REQUEST_NONE;
+    }
 }
 
 void init_chunk(Chunk *chunk, int p, int q) {
     chunk->p = p;
     chunk->q = q;
-    chunk->faces = 0;
+    memset(chunk->faces, 0, sizeof(chunk->faces));
     chunk->sign_faces = 0;
-    chunk->buffer = 0;
+    chunk->request = REQUEST_NONE;
+    memset(chunk->blocks, 0, sizeof(chunk->blocks));
     chunk->sign_buffer = 0;
+    chunk->query = 0;
+    chunk->query_pending = 0;
+    chunk->occluded = 0;
     dirty_chunk(chunk);
     SignList *signs = &chunk->signs;
     sign_list_alloc(signs, 16);
@@ -1234,6 +1452,8 @@ void init_chunk(Chunk *chunk, int p, int q) {
     int dz = q * CHUNK_SIZE - 1;
     map_alloc(block_map, dx, dy, dz, 0x7fff);
     map_alloc(light_map, dx, dy, dz, 0xf);
+    chunk->heights = malloc(sizeof(HeightMap));
+    build_heights(chunk->heights, block_map, p, q);
 }
 
 void create_chunk(Chunk *chunk, int p, int q) {
@@ -1245,7 +1465,9 @@ void create_chunk(Chunk *chunk, int p, int q) {
     item->q = chunk->q;
     item->block_maps[1][1] = &chunk->map;
     item->light_maps[1][1] = &chunk->lights;
+    item->height_maps[1][1] = chunk->heights;
     load_chunk(item);
+    collide_invalidate_chunk(&g->collide, p, q);
 
     request_chunk(p, q);
 }
@@ -1269,11 +1491,18 @@ void delete_chunks() {
             }
         }
         if (delete) {
+            if (chunk->request == REQUEST_SENT) {
+                client_cancel(chunk->p, chunk->q);
+            }
             map_free(&chunk->map);
             map_free(&chunk->lights);
+            free(chunk->heights);
             sign_list_free(&chunk->signs);
-            del_buffer(chunk->buffer);
+            for (int j = 0; j < LODS; j++) {
+                arena_release(chunk->blocks + j);
+            }
             del_buffer(chunk->sign_buffer);
+            glDeleteQueries(1, &chunk->query);
             Chunk *other = g->chunks + (--count);
             memcpy(chunk, other, sizeof(Chunk));
         }
@@ -1286,11 +1515,16 @@ void delete_all_chunks() {
         Chunk *chunk = g->chunks + i;
         map_free(&chunk->map);
         map_free(&chunk->lights);
+        free(chunk->heights);
         sign_list_free(&chunk->signs);
-        del_buffer(chunk->buffer);
+        for (int j = 0; j < LODS; j++) {
+            arena_release(chunk->blocks + j);
+        }
         del_buffer(chunk->sign_buffer);
+        glDeleteQueries(1, &chunk->query);
     }
     g->chunk_count = 0;
+    collide_invalidate(&g->collide);
 }
 
 void check_workers() {
@@ -1308,6 +1542,10 @@ void check_workers() {
                     map_free(&chunk->lights);
                     map_copy(&chunk->map, block_map);
                     map_copy(&chunk->lights, light_map);
+                    memcpy(chunk->heights, item->height_maps[1][1],
+                        sizeof(HeightMap));
+                    collide_invalidate_chunk(
+                        &g->collide, item->p, item->q);
                     request_chunk(item->p, item->q);
                 }
                 generate_chunk(chunk, item);
@@ -1324,6 +1562,7 @@ void check_workers() {
                         map_free(light_map);
                         free(light_map);
                     }
+                    free(item->height_maps[a][b]);
                 }
             }
             worker->state = WORKER_IDLE;
@@ -1356,14 +1595,62 @@ void force_chunks(Player *player) {
     }
 }
 
+int chunk_score(int a, int b, int p, int q, int priority) {
+    int distance = MAX(ABS(a - p), ABS(b - q));
+    int invisible = !cull_grid_visible(&g->cull, a, b);
+    return (invisible << 24) | (priority << 16) | distance;
+}
+
+void send_chunk_requests(Player *player) {
+    if (!get_client_enabled()) {
+        return;
+    }
+    double now = monotonic_time();
+    int in_flight = 0;
+    for (int i = 0; i < g->chunk_count; i++) {
+        Chunk *chunk = g->chunks + i;
+        if (chunk->request != REQUEST_SENT) {
+            continue;
+        }
+        if (now - chunk->request_time > CHUNK_REQUEST_TIMEOUT) {
+            client_cancel(chunk->p, chunk->q);
+            chunk->request = REQUEST_QUEUED;
+        }
+        else {
+            in_flight++;
+        }
+    }
+    if (in_flight >= CHUNK_REQUEST_WINDOW) {
+        return;
+    }
+    State *s = &player->state;
+    int p = chunked(s->x);
+    int q = chunked(s->z);
+    for (; in_flight < CHUNK_REQUEST_WINDOW; in_flight++) {
+        Chunk *best = 0;
+        int best_score = 0;
+        for (int i = 0; i < g->chunk_count; i++) {
+            Chunk *chunk = g->chunks + i;
+            if (chunk->request != REQUEST_QUEUED) {
+                continue;
+            }
+            int score = chunk_score(chunk->p, chunk->q, p, q, 0);
+            if (!best || score < best_score) {
+                best = chunk;
+                best_score = score;
+            }
+        }
+        if (!best) {
+            break;
+        }
+        client_chunk(best->p, best->q, db_get_key(best->p, best->q));
+        best->request = REQUEST_SENT;
+        best->request_time = now;
+    }
+}
+
 void ensure_chunks_worker(Player *player, Worker *worker) {
     State *s = &player->state;
-    float matrix[16];
-    set_matrix_3d(
-        matrix, g->width, g->height,
-        s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
-    float planes[6][4];
-    frustum_planes(planes, g->render_radius, matrix);
     int p = chunked(s->x);
     int q = chunked(s->z);
     int r = g->create_radius;
@@ -1383,13 +1670,11 @@ void ensure_chunks_worker(Player *player, Worker *worker) {
             if (chunk && !chunk->dirty) {
                 continue;
             }
-            int distance = MAX(ABS(dp), ABS(dq));
-            int invisible = !chunk_visible(planes, a, b, 0, 256);
             int priority = 0;
             if (chunk) {
-                priority = chunk->buffer && chunk->dirty;
+                priority = chunk->blocks[0].size && chunk->dirty;
             }
-            int score = (invisible << 24) | (priority << 16) | distance;
+            int score = chunk_score(a, b, p, q, priority);
             if (score < best_score) {
                 best_score = score;
                 best_a = a;
@@ -1429,12 +1714,16 @@ void ensure_chunks_worker(Player *player, Worker *worker) {
                 map_copy(block_map, &other->map);
                 Map *light_map = malloc(sizeof(Map));
                 map_copy(light_map, &other->lights);
+                HeightMap *heights = malloc(sizeof(HeightMap));
+                memcpy(heights, other->heights, sizeof(HeightMap));
                 item->block_maps[dp + 1][dq + 1] = block_map;
                 item->light_maps[dp + 1][dq + 1] = light_map;
+                item->height_maps[dp + 1][dq + 1] = heights;
             }
             else {
                 item->block_maps[dp + 1][dq + 1] = 0;
                 item->light_maps[dp + 1][dq + 1] = 0;
+                item->height_maps[dp + 1][dq + 1] = 0;
             }
         }
     }
@@ -1446,6 +1735,7 @@ void ensure_chunks_worker(Player *player, Worker *worker) {
 void ensure_chunks(Player *player) {
     check_workers();
     force_chunks(player);
+    send_chunk_requests(player);
     for (int i = 0; i < WORKERS; i++) {
         Worker *worker = g->workers + i;
         mtx_lock(&worker->mtx);
@@ -1477,10 +1767,88 @@ int worker_run(void *arg) {
     return 0;
 }
 
+void wait_workers() {
+    // workers are never joined, this waits until none is inside
+    // load_chunk or compute_chunk
+    for (int i = 0; i < WORKERS; i++) {
+        Worker *worker = g->workers + i;
+        while (1) {
+            mtx_lock(&worker->mtx);
+            int busy = worker->state == WORKER_BUSY;
+            mtx_unlock(&worker->mtx);
+            if (!busy) {
+                break;
+            }
+            thrd_yield();
+        }
+    }
+}
+
+// edits made between begin_edit and end_edit (a builder command or a
+// burst of server messages) reach the chunk maps immediately, but the
+// last chunk looked up is kept, redraws are collected so each chunk is
+// dirtied once, and db writes go to the worker as one batch
+Chunk *burst_find_chunk(int p, int q) {
+    Chunk *chunk = g->burst_chunk;
+    if (chunk && chunk->p == p && chunk->q == q) {
+        return chunk;
+    }
+    chunk = find_chunk(p, q);
+    if (chunk) {
+        g->burst_chunk = chunk;
+    }
+    return chunk;
+}
+
+void burst_dirty(Chunk *chunk) {
+    for (int i = g->burst_dirty_count - 1; i >= 0; i--) {
+        if (g->burst_dirty[i] == chunk) {
+            return;
+        }
+    }
+    if (g->burst_dirty_count < MAX_CHUNKS) {
+        g->burst_dirty[g->burst_dirty_count++] = chunk;
+    }
+    else {
+        dirty_chunk(chunk);
+    }
+}
+
+void begin_edit() {
+    if (g->edit_depth++ == 0) {
+        db_begin_batch();
+    }
+}
+
+void end_edit() {
+    if (--g->edit_depth) {
+        return;
+    }
+    for (int i = 0; i < g->burst_dirty_count; i++) {
+        dirty_chunk(g->burst_dirty[i]);
+    }
+    g->burst_dirty_count = 0;
+    g->burst_chunk = 0;
+    db_end_batch();
+}
+
+Chunk *edit_find_chunk(int p, int q) {
+    return g->edit_depth ? burst_find_chunk(p, q) : find_chunk(p, q);
+}
+
+void edit_dirty_chunk(Chunk *chunk) {
+    if (g->edit_depth) {
+        burst_dirty(chunk);
+    }
+    else {
+        dirty_chunk(chunk);
+    }
+}
+
 void unset_sign(int x, int y, int z) {
     int p = chunked(x);
     int q = chunked(z);
-    Chunk *chunk = find_chunk(p, q);
+    Chunk *chunk = edit_find_chunk(p, q);
     if (chunk) {
         SignList *signs = &chunk->signs;
         if (sign_list_remove_all(signs, x, y, z)) {
@@ -1549,11 +1917,11 @@ void toggle_light(int x, int y, int z) {
 }
 
 void set_light(int p, int q, int x, int y, int z, int w) {
-    Chunk *chunk = find_chunk(p, q);
+    Chunk *chunk = edit_find_chunk(p, q);
     if (chunk) {
         Map *map = &chunk->lights;
         if (map_set(map, x, y, z, w)) {
-            dirty_chunk(chunk);
+            edit_dirty_chunk(chunk);
             db_insert_light(p, q, x, y, z, w);
         }
     }
@@ -1562,15 +1930,19 @@ void set_light(int p, int q, int x, int y, int z, int w) {
     }
 }
 
-void _set_block(int p, int q, int x, int y, int z, int w, int dirty) {
-    Chunk *chunk = find_chunk(p, q);
+int apply_block(Chunk *chunk, int p, int q, int x, int y, int z, int w) {
+    int result = 0;
     if (chunk) {
         Map *map = &chunk->map;
         if (map_set(map, x, y, z, w)) {
-            if (dirty) {
-                dirty_chunk(chunk);
+            update_heights(chunk, x, y, z, w);
+            // border copies in neighboring chunks are not read by the
+            // collision window
+            if (chunked(x) == p && chunked(z) == q) {
+                collide_set_block(&g->collide, x, y, z, w);
             }
             db_insert_block(p, q, x, y, z, w);
+            result = 1;
         }
     }
     else {
@@ -1580,6 +1952,14 @@ void _set_block(int p, int q, int x, int y, int z, int w, int dirty) {
         unset_sign(x, y, z);
         set_light(p, q, x, y, z, 0);
     }
+    return result;
+}
+
+void _set_block(int p, int q, int x, int y, int z, int w, int dirty) {
+    Chunk *chunk = edit_find_chunk(p, q);
+    if (apply_block(chunk, p, q, x, y, z, w) && dirty) {
+        edit_dirty_chunk(chunk);
+    }
 }
 
 void set_block(int x, int y, int z, int w) {
@@ -1634,10 +2014,42 @@ void builder_block(int x, int y, int z, int w) {
     }
 }
 
+int chunk_lod(int distance) {
+    // the phase mask clips depth at 64 blocks, so detail only drops
+    // beyond the distance where it can still see a difference
+    if (distance > LOD2_CHUNK_RADIUS) {
+        return 2;
+    }
+    if (distance > LOD1_CHUNK_RADIUS) {
+        return 1;
+    }
+    return 0;
+}
+
+void collect_occlusion() {
+    // results of the box queries issued last frame, a chunk keeps its
+    // previous state until its result is available
+    for (int i = 0; i < g->chunk_count; i++) {
+        Chunk *chunk = g->chunks + i;
+        if (!chunk->query_pending) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(
+            chunk->query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint samples = 0;
+        glGetQueryObjectuiv(chunk->query, GL_QUERY_RESULT, &samples);
+        chunk->occluded = samples == 0;
+        chunk->query_pending = 0;
+    }
+}
+
 int render_chunks(Attrib *attrib, Player *player) {
     int result = 0;
     State *s = &player->state;
-    ensure_chunks(player);
     int p = chunked(s->x);
     int q = chunked(s->z);
     float light = get_daylight();
@@ -1647,6 +2059,13 @@ int render_chunks(Attrib *attrib, Player *player) {
         s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
     float planes[6][4];
     frustum_planes(planes, g->render_radius, matrix);
+    int plane_count = g->ortho ? 4 : 6;
+    // the column visibility is shared with the chunk scheduler
+    cull_grid_update(&g->cull, planes, plane_count, p, q, g->delete_radius);
+    ensure_chunks(player);
+    if (g->occlusion) {
+        collect_occlusion();
+    }
     glUseProgram(attrib->program);
     glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
     glUniform3f(attrib->camera, s->x, s->y, s->z);
@@ -1656,22 +2075,106 @@ int render_chunks(Attrib *attrib, Player *player) {
     glUniform1f(attrib->extra3, g->render_radius * CHUNK_SIZE);
     glUniform1i(attrib->extra4, g->ortho);
     glUniform1f(attrib->timer, time_of_day());
+    CullBoxes *boxes = &g->chunk_boxes;
+    cull_boxes_clear(boxes);
     for (int i = 0; i < g->chunk_count; i++) {
         Chunk *chunk = g->chunks + i;
-        if (chunk_distance(chunk, p, q) > g->render_radius) {
+        if (chunk_distance(chunk, p, q) > g->render_radius ||
+            !cull_grid_visible(&g->cull, chunk->p, chunk->q))
+        {
+            chunk->occluded = 0;
             continue;
         }
-        if (!chunk_visible(
-            planes, chunk->p, chunk->q, chunk->miny, chunk->maxy))
-        {
+        cull_boxes_add_chunk(
+            boxes, i, chunk->p, chunk->q, chunk->miny, chunk->maxy);
+    }
+    cull_boxes_test(boxes, planes, plane_count);
+    g->occluded_faces = 0;
+    g->occluded_chunks = 0;
+    for (int i = 0; i < boxes->count; i++) {
+        Chunk *chunk = g->chunks + boxes->ids[i];
+        if (!boxes->visible[i]) {
+            chunk->occluded = 0;
+            continue;
+        }
+        int distance = chunk_distance(chunk, p, q);
+        int lod = chunk_lod(distance);
+        // the chunks around the camera are always drawn, their boxes
+        // can enclose the near plane
+        if (g->occlusion && chunk->occluded && distance > 1) {
+            g->occluded_faces += chunk->faces[lod];
+            g->occluded_chunks++;
             continue;
         }
-        draw_chunk(attrib, chunk);
-        result += chunk->faces;
+        draw_chunk(chunk, lod);
+        result += chunk->faces[lod];
     }
+    arena_flush();
+    g->drawn_faces = result;
     return result;
 }
 
+void render_occlusion(Attrib *attrib, Player *player) {
+    // bounding boxes of the chunks in the frustum are drawn against the
+    // depth buffer with occlusion queries, render_chunks uses the
+    // results on the next frame
+    if (!g->occlusion) {
+        return;
+    }
+    State *s = &player->state;
+    int p = chunked(s->x);
+    int q = chunked(s->z);
+    CullBoxes *boxes = &g->chunk_boxes;
+    GLfloat *data = malloc(sizeof(GLfloat) * 108 * (boxes->count + 1));
+    Chunk **chunks = malloc(sizeof(Chunk *) * (boxes->count + 1));
+    int count = 0;
+    for (int i = 0; i < boxes->count; i++) {
+        Chunk *chunk = g->chunks + boxes->ids[i];
+        if (!boxes->visible[i] || chunk->query_pending ||
+            chunk_distance(chunk, p, q) <= 1)
+        {
+            continue;
+        }
+        // block faces extend half a block past miny and maxy
+        make_box(data + count * 108,
+            boxes->minx[i], boxes->miny[i] - 1, boxes->minz[i],
+            boxes->maxx[i], boxes->maxy[i] + 1, boxes->maxz[i]);
+        chunks[count++] = chunk;
+    }
+    if (count) {
+        float matrix[16];
+        set_matrix_3d(
+            matrix, g->width, g->height,
+            s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho,
+            g->render_radius);
+        GLuint buffer = gen_buffer(sizeof(GLfloat) * 108 * count, data);
+        glUseProgram(attrib->program);
+        glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(attrib->position);
+        glVertexAttribPointer(attrib->position, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        for (int i = 0; i < count; i++) {
+            Chunk *chunk = chunks[i];
+            if (!chunk->query) {
+                glGenQueries(1, &chunk->query);
+            }
+            glBeginQuery(GL_SAMPLES_PASSED, chunk->query);
+            glDrawArrays(GL_TRIANGLES, i * 36, 36);
+            glEndQuery(GL_SAMPLES_PASSED);
+            chunk->query_pending = 1;
+        }
+        glDisableVertexAttribArray(attrib->position);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        del_buffer(buffer);
+    }
+    free(data);
+    free(chunks);
+}
+
 void render_signs(Attrib *attrib, Player *player) {
     State *s = &player->state;
     int p = chunked(s->x);
@@ -2046,6 +2549,78 @@ void tree(Block *block) {
     }
 }
 
+void stop_recording() {
+    if (!capture_recording()) {
+        return;
+    }
+    capture_record_stop();
+    CaptureStats stats;
+    char text[MAX_TEXT_LENGTH];
+    capture_stats(&stats);
+    snprintf(text, MAX_TEXT_LENGTH,
+        "Recorded %u frames, %u dropped, %u writes failed",
+        stats.frames, stats.dropped_frames, stats.failed);
+    add_message(text);
+    printf("%s\n", text);
+}
+
+void start_recording(const char *name) {
+    stop_recording();
+    char text[MAX_TEXT_LENGTH];
+    if (capture_record_start(name)) {
+        snprintf(text, MAX_TEXT_LENGTH, "Recording to %s.csv", name);
+    }
+    else {
+        snprintf(text, MAX_TEXT_LENGTH, "Unable to record to %s.csv", name);
+    }
+    add_message(text);
+}
+
+void load_calibration(GLuint texture) {
+    // the oled pass looks up where each pixel samples the slm image, so
+    // a new calibration only needs a new table
+    Calibration calib;
+    char text[MAX_TEXT_LENGTH];
+    calib_default(&calib);
+    if (calib_load(&calib, g->calibration_path)) {
+        snprintf(text, MAX_TEXT_LENGTH,
+            "Loaded calibration %s", g->calibration_path);
+    }
+    else {
+        snprintf(text, MAX_TEXT_LENGTH,
+            "Unable to load calibration %s, using the default",
+            g->calibration_path);
+    }
+    add_message(text);
+    float *data = malloc(sizeof(float) * 2 * OLED_SIZE * OLED_SIZE);
+    calib_remap(&calib, data, OLED_SIZE, SLM_WIDTH, SLM_HEIGHT);
+    glActiveTexture(GL_TEXTURE12);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, OLED_SIZE, OLED_SIZE, 0,
+        GL_RG, GL_FLOAT, data);
+    free(data);
+}
+
+void upload_phase(GLuint texture) {
+    // only the tiles recomputed by the last phase_update are sent
+    PhaseMask *mask = &g->phase;
+    glActiveTexture(GL_TEXTURE13);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, mask->width);
+    for (int i = 0; i < mask->tiles_x * mask->tiles_y; i++) {
+        int x, y, width, height;
+        if (!mask->dirty[i]) {
+            continue;
+        }
+        phase_tile(mask, i, &x, &y, &width, &height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height,
+            GL_LUMINANCE, GL_UNSIGNED_BYTE,
+            mask->phase + y * mask->width + x);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
 void parse_command(const char *buffer, int forward) {
     char username[128] = {0};
     char token[128] = {0};
@@ -2053,6 +2628,7 @@ void parse_command(const char *buffer, int forward) {
     int server_port = DEFAULT_PORT;
     char filename[MAX_PATH_LENGTH];
     int radius, count, xc, yc, zc;
+    begin_edit();
     if (sscanf(buffer, "/identity %128s %128s", username, token) == 2) {
         db_auth_set(username, token);
         add_message("Successfully imported identity token!");
@@ -2100,6 +2676,60 @@ void parse_command(const char *buffer, int forward) {
             add_message("Viewing distance must be between 1 and 24.");
         }
     }
+    else if (strcmp(buffer, "/occlusion") == 0) {
+        char text[MAX_TEXT_LENGTH];
+        snprintf(text, MAX_TEXT_LENGTH,
+            "Occlusion culling %s: %d faces drawn, %d in %d chunks culled",
+            g->occlusion ? "on" : "off", g->drawn_faces,
+            g->occluded_faces, g->occluded_chunks);
+        add_message(text);
+    }
+    else if (strcmp(buffer, "/phase") == 0) {
+        PhaseMask *mask = &g->phase;
+        char text[MAX_TEXT_LENGTH];
+        snprintf(text, MAX_TEXT_LENGTH,
+            "Phase mask: %d of %d tiles updated, %.1f per frame",
+            mask->updated, mask->tiles_x * mask->tiles_y,
+            mask->frames ? mask->total_updated / mask->frames : 0.0);
+        add_message(text);
+    }
+    else if (strcmp(buffer, "/occlusion on") == 0) {
+        g->occlusion = 1;
+    }
+    else if (strcmp(buffer, "/occlusion off") == 0) {
+        g->occlusion = 0;
+    }
+    else if (strcmp(buffer, "/record") == 0) {
+        if (capture_recording()) {
+            stop_recording();
+        }
+        else {
+            time_t now = time(NULL);
+            strftime(filename, MAX_PATH_LENGTH, "record_%Y%m%d_%H%M%S",
+                localtime(&now));
+            start_recording(filename);
+        }
+    }
+    else if (sscanf(buffer, "/record %128s", filename) == 1) {
+        start_recording(filename);
+    }
+    else if (strcmp(buffer, "/calibrate") == 0) {
+        g->calibration_changed = 1;
+    }
+    else if (sscanf(buffer, "/calibrate %255s", filename) == 1) {
+        snprintf(g->calibration_path, MAX_PATH_LENGTH, "%s", filename);
+        g->calibration_changed = 1;
+    }
+    else if (strcmp(buffer, "/cache") == 0) {
+        WorldCacheStats stats;
+        char text[MAX_TEXT_LENGTH];
+        world_cache_stats(&stats);
+        snprintf(text, MAX_TEXT_LENGTH,
+            "Terrain cache: %u chunks, %u KB, %u hits, %u misses, %u evicted",
+            stats.count, stats.bytes / 1024, stats.hits, stats.misses,
+            stats.evictions);
+        add_message(text);
+    }
     else if (strcmp(buffer, "/copy") == 0) {
         copy();
     }
@@ -2154,6 +2784,7 @@ void parse_command(const char *buffer, int forward) {
     else if (forward) {
         client_talk(buffer);
     }
+    end_edit();
 }
 
 void on_light() {
@@ -2518,138 +3149,230 @@ void handle_movement(double dt) {
     }
     // float speed = g->flying ? 20 : 5;
     float speed = g->flying ? 3 : 3;
-    int estimate = roundf(sqrtf(
-        powf(vx * speed, 2) +
-        powf(vy * speed + ABS(dy) * 2, 2) +
-        powf(vz * speed, 2)) * dt * 8);
-    int step = MAX(8, estimate);
-    float ut = dt / step;
-    vx = vx * ut * speed;
+    vx = vx * dt * speed;
     if (!g->flying) {
-      vy = vy * ut * speed;
+      vy = vy * dt * speed;
     } else {
       if(!glfwGetKey(g->window, CRAFT_KEY_JUMP)) {
         vy = 0;  // disable descending or ascending unless jump is pressed
       } else {
-        vy = vy * ut * speed * 0.6;  // rise slowly
+        vy = vy * dt * speed * 0.6;  // rise slowly
       }
     }
-    vz = vz * ut * speed;
-    for (int i = 0; i < step; i++) {
-        if (g->flying) {
-            dy = 0;
-        }
-        else {
-            dy -= ut * 25;
-            dy = MAX(dy, -250);
-        }
-        s->x += vx;
-        s->y += vy + dy * ut;
-        s->z += vz;
-        if (collide(2, &s->x, &s->y, &s->z)) {
-            dy = 0;
-        }
+    vz = vz * dt * speed;
+    float fall = 0;
+    if (g->flying) {
+        dy = 0;
+    }
+    else {
+        // trapezoid rule, exact while the fall speed is below the limit
+        float previous = dy;
+        dy -= dt * 25;
+        dy = MAX(dy, -250);
+        fall = (previous + dy) / 2 * dt;
+    }
+    int hit = collide_move(&g->collide, chunk_map, 0, 2,
+        &s->x, &s->y, &s->z, vx, vy + fall, vz);
+    if (hit & COLLIDE_Y) {
+        dy = 0;
     }
     if (s->y < 0) {
         s->y = highest_block(s->x, s->z) + 2;
     }
 }
 
-void parse_buffer(char *buffer) {
+void burst_block(int p, int q, int x, int y, int z, int w) {
+    State *s = &g->players->state;
+    apply_block(edit_find_chunk(p, q), p, q, x, y, z, w);
+    if (player_intersects_block(2, s->x, s->y, s->z, x, y, z)) {
+        s->y = highest_block(s->x, s->z) + 2;
+    }
+}
+
+typedef void (*parse_func)(const char *args);
+
+void parse_you(const char *args) {
     Player *me = g->players;
     State *s = &g->players->state;
-    char *key;
-    char *line = tokenize(buffer, "\n", &key);
-    while (line) {
-        int pid;
-        float ux, uy, uz, urx, ury;
-        if (sscanf(line, "U,%d,%f,%f,%f,%f,%f",
-            &pid, &ux, &uy, &uz, &urx, &ury) == 6)
-        {
-            me->id = pid;
-            s->x = ux; s->y = uy; s->z = uz; s->rx = urx; s->ry = ury;
-            force_chunks(me);
-            if (uy == 0) {
-                s->y = highest_block(s->x, s->z) + 2;
-            }
-        }
-        int bp, bq, bx, by, bz, bw;
-        if (sscanf(line, "B,%d,%d,%d,%d,%d,%d",
-            &bp, &bq, &bx, &by, &bz, &bw) == 6)
-        {
-            _set_block(bp, bq, bx, by, bz, bw, 0);
-            if (player_intersects_block(2, s->x, s->y, s->z, bx, by, bz)) {
-                s->y = highest_block(s->x, s->z) + 2;
-            }
-        }
-        if (sscanf(line, "L,%d,%d,%d,%d,%d,%d",
-            &bp, &bq, &bx, &by, &bz, &bw) == 6)
-        {
-            set_light(bp, bq, bx, by, bz, bw);
+    int pid;
+    float v[5];
+    if (!(args = scan_int(args, &pid)) || scan_floats(args, v, 5) != 5) {
+        return;
+    }
+    me->id = pid;
+    if (g->reconnecting) {
+        // keep our own position, the server only knows the spawn point
+        g->reconnecting = 0;
+        client_position(s->x, s->y, s->z, s->rx, s->ry);
+        return;
+    }
+    s->x = v[0]; s->y = v[1]; s->z = v[2]; s->rx = v[3]; s->ry = v[4];
+    g->burst_chunk = 0;
+    force_chunks(me);
+    if (v[1] == 0) {
+        s->y = highest_block(s->x, s->z) + 2;
+    }
+}
+
+void parse_block(const char *args) {
+    int v[6];
+    if (scan_ints(args, v, 6) == 6) {
+        burst_block(v[0], v[1], v[2], v[3], v[4], v[5]);
+    }
+}
+
+void parse_light(const char *args) {
+    int v[6];
+    if (scan_ints(args, v, 6) == 6) {
+        set_light(v[0], v[1], v[2], v[3], v[4], v[5]);
+    }
+}
+
+void parse_position(const char *args) {
+    int pid;
+    float v[5];
+    if (!(args = scan_int(args, &pid)) || scan_floats(args, v, 5) != 5) {
+        return;
+    }
+    Player *player = find_player(pid);
+    if (!player && g->player_count < MAX_PLAYERS) {
+        player = g->players + g->player_count;
+        g->player_count++;
+        player->id = pid;
+        player->buffer = 0;
+        snprintf(player->name, MAX_NAME_LENGTH, "player%d", pid);
+        update_player(player, v[0], v[1], v[2], v[3], v[4], 1); // twice
+    }
+    if (player) {
+        update_player(player, v[0], v[1], v[2], v[3], v[4], 1);
+    }
+}
+
+void parse_disconnect(const char *args) {
+    int pid;
+    if (scan_int(args, &pid)) {
+        delete_player(pid);
+    }
+}
+
+void parse_key(const char *args) {
+    int v[3];
+    if (scan_ints(args, v, 3) == 3) {
+        db_set_key(v[0], v[1], v[2]);
+    }
+}
+
+void parse_done(const char *args) {
+    int v[2];
+    if (scan_ints(args, v, 2) == 2) {
+        chunk_request_done(v[0], v[1]);
+    }
+}
+
+void parse_redraw(const char *args) {
+    int v[2];
+    if (scan_ints(args, v, 2) == 2) {
+        Chunk *chunk = edit_find_chunk(v[0], v[1]);
+        if (chunk) {
+            edit_dirty_chunk(chunk);
         }
-        float px, py, pz, prx, pry;
-        if (sscanf(line, "P,%d,%f,%f,%f,%f,%f",
-            &pid, &px, &py, &pz, &prx, &pry) == 6)
-        {
-            Player *player = find_player(pid);
-            if (!player && g->player_count < MAX_PLAYERS) {
-                player = g->players + g->player_count;
-                g->player_count++;
-                player->id = pid;
-                player->buffer = 0;
-                snprintf(player->name, MAX_NAME_LENGTH, "player%d", pid);
-                update_player(player, px, py, pz, prx, pry, 1); // twice
-            }
-            if (player) {
-                update_player(player, px, py, pz, prx, pry, 1);
-            }
+    }
+}
+
+void parse_time(const char *args) {
+    double elapsed;
+    int day_length;
+    if ((args = scan_double(args, &elapsed)) && scan_int(args, &day_length)
+        && day_length > 0)
+    {
+        glfwSetTime(fmod(elapsed, day_length));
+        g->day_length = day_length;
+        g->time_changed = 1;
+    }
+}
+
+void parse_talk(const char *args) {
+    add_message(args);
+}
+
+void parse_nick(const char *args) {
+    int pid;
+    if (!(args = scan_int(args, &pid)) || *args == '\0') {
+        return;
+    }
+    Player *player = find_player(pid);
+    if (player) {
+        int length = strcspn(args, " \t");
+        length = MIN(length, MAX_NAME_LENGTH - 1);
+        memcpy(player->name, args, length);
+        player->name[length] = '\0';
+    }
+}
+
+void parse_sign(const char *args) {
+    int v[6];
+    for (int i = 0; i < 6; i++) {
+        if (!args || !(args = scan_int(args, v + i))) {
+            return;
         }
-        if (sscanf(line, "D,%d", &pid) == 1) {
-            delete_player(pid);
+    }
+    char text[MAX_SIGN_LENGTH];
+    strncpy(text, args, MAX_SIGN_LENGTH - 1);
+    text[MAX_SIGN_LENGTH - 1] = '\0';
+    _set_sign(v[0], v[1], v[2], v[3], v[4], v[5], text, 0);
+}
+
+void parse_line(char *line) {
+    static const parse_func handlers[128] = {
+        ['B'] = parse_block,
+        ['C'] = parse_done,
+        ['D'] = parse_disconnect,
+        ['E'] = parse_time,
+        ['K'] = parse_key,
+        ['L'] = parse_light,
+        ['N'] = parse_nick,
+        ['P'] = parse_position,
+        ['R'] = parse_redraw,
+        ['S'] = parse_sign,
+        ['T'] = parse_talk,
+        ['U'] = parse_you,
+    };
+    unsigned char type = line[0];
+    if (type < 128 && handlers[type] && line[1] == ',') {
+        handlers[type](line + 2);
+    }
+}
+
+void parse_chunk(const char *data, int length) {
+    int p, q;
+    const unsigned char *run;
+    int count = client_chunk_runs(data, length, &p, &q, &run);
+    int ox = p * CHUNK_SIZE - 1;
+    int oz = q * CHUNK_SIZE - 1;
+    for (int i = 0; i < count; i++, run += CHUNK_RUN_SIZE) {
+        int x = ox + run[0];
+        int z = oz + run[1];
+        int w = (signed char)run[4];
+        for (int y = run[2]; y < run[2] + run[3]; y++) {
+            burst_block(p, q, x, y, z, w);
         }
-        int kp, kq, kk;
-        if (sscanf(line, "K,%d,%d,%d", &kp, &kq, &kk) == 3) {
-            db_set_key(kp, kq, kk);
+    }
+}
+
+void parse_messages() {
+    char *data;
+    int length, type;
+    begin_edit();
+    while ((type = client_recv(&data, &length))) {
+        if (type == FRAME_CHUNK) {
+            parse_chunk(data, length);
         }
-        if (sscanf(line, "R,%d,%d", &kp, &kq) == 2) {
-            Chunk *chunk = find_chunk(kp, kq);
-            if (chunk) {
-                dirty_chunk(chunk);
-            }
-        }
-        double elapsed;
-        int day_length;
-        if (sscanf(line, "E,%lf,%d", &elapsed, &day_length) == 2) {
-            glfwSetTime(fmod(elapsed, day_length));
-            g->day_length = day_length;
-            g->time_changed = 1;
-        }
-        if (line[0] == 'T' && line[1] == ',') {
-            char *text = line + 2;
-            add_message(text);
-        }
-        char format[64];
-        snprintf(
-            format, sizeof(format), "N,%%d,%%%ds", MAX_NAME_LENGTH - 1);
-        char name[MAX_NAME_LENGTH];
-        if (sscanf(line, format, &pid, name) == 2) {
-            Player *player = find_player(pid);
-            if (player) {
-                strncpy(player->name, name, MAX_NAME_LENGTH);
-            }
-        }
-        snprintf(
-            format, sizeof(format),
-            "S,%%d,%%d,%%d,%%d,%%d,%%d,%%%d[^\n]", MAX_SIGN_LENGTH - 1);
-        int face;
-        char text[MAX_SIGN_LENGTH] = {0};
-        if (sscanf(line, format,
-            &bp, &bq, &bx, &by, &bz, &face, text) >= 6)
-        {
-            _set_sign(bp, bq, bx, by, bz, face, text, 0);
+        else {
+            parse_line(data);
         }
-        line = tokenize(NULL, "\n", &key);
     }
+    client_recv_done();
+    end_edit();
 }
 
 void reset_model() {
@@ -2668,6 +3391,7 @@ void reset_model() {
     g->day_length = DAY_LENGTH;
     glfwSetTime(g->day_length / 3.0);
     g->time_changed = 1;
+    g->reconnecting = 0;
 }
 
 void error_callback(int error, const char* description) {
@@ -2767,6 +3491,20 @@ int main(int argc, char **argv) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, fbo_depth, 0);
 
+    // the block shader writes normalized diopters here, the phase mask
+    // reads them without unprojecting the depth buffer
+    GLuint fbo_diopter;
+    glGenTextures(1, &fbo_diopter);
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_2D, fbo_diopter);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, WIDTH, HEIGHT, 0, GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, fbo_diopter, 0);
+    const GLenum scene_buffers[2] = {
+        GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1
+    };
+
     GLuint fbo_color2;
     glGenTextures(1, &fbo_color2);
     glActiveTexture(GL_TEXTURE6);
@@ -2799,6 +3537,72 @@ int main(int argc, char **argv) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
+    // the fused output pass writes the phase mask and the oled image
+    // into these, the textures are shared and each window only blits
+    GLuint output_fbo;
+    glGenFramebuffers(1, &output_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, output_fbo);
+
+    GLuint output_phase;
+    glGenTextures(1, &output_phase);
+    glActiveTexture(GL_TEXTURE10);
+    glBindTexture(GL_TEXTURE_2D, output_phase);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, OUTPUT_WIDTH, OUTPUT_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, output_phase, 0);
+
+    GLuint output_oled;
+    glGenTextures(1, &output_oled);
+    glActiveTexture(GL_TEXTURE11);
+    glBindTexture(GL_TEXTURE_2D, output_oled);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, OUTPUT_WIDTH, OUTPUT_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, output_oled, 0);
+    const GLenum output_buffers[2] = {
+        GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1
+    };
+    glDrawBuffers(2, output_buffers);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    // framebuffers are not shared between contexts, the oled window
+    // reads its texture through its own
+    GLuint oled_fbo;
+    glfwMakeContextCurrent(g->window2);
+    glGenFramebuffers(1, &oled_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, oled_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, output_oled, 0);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glfwMakeContextCurrent(g->window);
+    GLsync output_fence = 0;
+
+    // phase mask of videos computed on the cpu, see phase.c
+    GLuint phase_texture;
+    glGenTextures(1, &phase_texture);
+    glActiveTexture(GL_TEXTURE13);
+    glBindTexture(GL_TEXTURE_2D, phase_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, SLM_WIDTH, SLM_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    GLuint phase_fbo;
+    glGenFramebuffers(1, &phase_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, phase_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, phase_texture, 0);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    GLuint calib_texture;
+    glGenTextures(1, &calib_texture);
+    glActiveTexture(GL_TEXTURE12);
+    glBindTexture(GL_TEXTURE_2D, calib_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    snprintf(g->calibration_path, MAX_PATH_LENGTH, "%s", CALIBRATION_PATH);
+    load_calibration(calib_texture);
+
     // LOAD SHADERS //
     Attrib block_attrib = {0};
     Attrib line_attrib = {0};
@@ -2806,6 +3610,7 @@ int main(int argc, char **argv) {
     Attrib sky_attrib = {0};
     Attrib color_attrib = {0};
     Attrib depth_attrib = {0};
+    Attrib output_attrib = {0};
     GLuint program;
 
     program = load_program(
@@ -2822,6 +3627,8 @@ int main(int argc, char **argv) {
     block_attrib.extra4 = glGetUniformLocation(program, "ortho");
     block_attrib.camera = glGetUniformLocation(program, "camera");
     block_attrib.timer = glGetUniformLocation(program, "timer");
+    arena_init(block_attrib.position, block_attrib.normal, block_attrib.uv);
+    capture_init();
 
     program = load_program(
         "shaders/line_vertex.glsl", "shaders/line_fragment.glsl");
@@ -2857,6 +3664,7 @@ int main(int argc, char **argv) {
     color_attrib.matrix = glGetUniformLocation(program, "matrix");
     color_attrib.sampler = glGetUniformLocation(program, "sampler");
     color_attrib.extra1 = glGetUniformLocation(program, "mode");
+    color_attrib.extra2 = glGetUniformLocation(program, "remap_sampler");
 
     program = load_program(
         "shaders/depth_vertex.glsl", "shaders/depth_fragment.glsl");
@@ -2868,6 +3676,17 @@ int main(int argc, char **argv) {
     depth_attrib.sampler = glGetUniformLocation(program, "sampler");
     depth_attrib.extra1 = glGetUniformLocation(program, "mode");
 
+    program = load_program(
+        "shaders/depth_vertex.glsl", "shaders/output_fragment.glsl");
+    output_attrib.program = program;
+    output_attrib.position = glGetAttribLocation(program, "position");
+    output_attrib.uv = glGetAttribLocation(program, "uv");
+    output_attrib.matrix = glGetUniformLocation(program, "matrix");
+    output_attrib.sampler = glGetUniformLocation(program, "sampler");
+    output_attrib.extra1 = glGetUniformLocation(program, "depth_sampler");
+    output_attrib.extra2 = glGetUniformLocation(program, "remap_sampler");
+    output_attrib.extra3 = glGetUniformLocation(program, "cpu_phase");
+
     // CHECK COMMAND LINE ARGUMENTS //
     if (argc == 2 || argc == 3) {
         g->mode = MODE_ONLINE;
@@ -2885,8 +3704,10 @@ int main(int argc, char **argv) {
     g->render_radius = RENDER_CHUNK_RADIUS;
     g->delete_radius = DELETE_CHUNK_RADIUS;
     g->sign_radius = RENDER_SIGN_RADIUS;
+    g->occlusion = OCCLUSION_CULLING;
 
     // INITIALIZE WORKER THREADS
+    world_cache_init(WORLD_CACHE_BYTES);
     for (int i = 0; i < WORKERS; i++) {
         Worker *worker = g->workers + i;
         worker->index = i;
@@ -2934,7 +3755,8 @@ int main(int argc, char **argv) {
             client_enable();
             client_connect(g->server_addr, g->server_port);
             client_start();
-            client_version(1);
+            client_version(
+                USE_BINARY_PROTOCOL ? PROTOCOL_BINARY : PROTOCOL_TEXT);
             login();
         }
 
@@ -3009,6 +3831,7 @@ int main(int argc, char **argv) {
                         flip_image_vertical(vid_color_frames[k], vid_width, vid_height);
                         flip_image_vertical(vid_depth_frames[k], vid_width, vid_height);
                     }
+                    phase_reset(&g->phase);
                 }
             }
 #endif
@@ -3030,7 +3853,8 @@ int main(int argc, char **argv) {
                 memset(&fps, 0, sizeof(fps));
             }
             update_fps(&fps);
-            printf("FPS: %d\n", fps.fps);
+            printf("FPS: %d, %u hitches, slowest frame %.1f ms\n",
+                fps.fps, fps.hitches, fps.worst * 1000);
             double now = glfwGetTime();
             double dt = now - previous;
             dt = MIN(dt, 0.2);
@@ -3043,13 +3867,23 @@ int main(int argc, char **argv) {
             // HANDLE MOVEMENT //
             handle_movement(dt);
 
-            // HANDLE DATA FROM SERVER //
-            char *buffer = client_recv();
-            if (buffer) {
-                parse_buffer(buffer);
-                free(buffer);
+            // RESYNC AFTER RECONNECT //
+            if (client_reconnected()) {
+                g->reconnecting = 1;
+                while (g->player_count > 1) {
+                    Player *other = g->players + g->player_count - 1;
+                    del_buffer(other->buffer);
+                    g->player_count--;
+                }
+                for (int i = 0; i < g->chunk_count; i++) {
+                    Chunk *chunk = g->chunks + i;
+                    request_chunk(chunk->p, chunk->q);
+                }
             }
 
+            // HANDLE DATA FROM SERVER //
+            parse_messages();
+
             // FLUSH DATABASE //
             if (now - last_commit > COMMIT_INTERVAL) {
                 last_commit = now;
@@ -3075,11 +3909,16 @@ int main(int argc, char **argv) {
 
             if (vid == 0) {
             // RENDER 3-D SCENE //
+            // clears the diopter target to 0, the far end of the range
+            glDrawBuffers(2, scene_buffers);
             glClear(GL_COLOR_BUFFER_BIT);
             glClear(GL_DEPTH_BUFFER_BIT);
+            glDrawBuffer(GL_COLOR_ATTACHMENT0);
             render_sky(&sky_attrib, player, sky_buffer);
             glClear(GL_DEPTH_BUFFER_BIT);
+            glDrawBuffers(2, scene_buffers);
             int face_count = render_chunks(&block_attrib, player);
+            render_occlusion(&line_attrib, player);
             }
             /*render_signs(&text_attrib, player);
             render_sign(&text_attrib, player);
@@ -3179,14 +4018,38 @@ int main(int argc, char **argv) {
                 }
             }*/
 
+            if (g->calibration_changed) {
+                g->calibration_changed = 0;
+                load_calibration(calib_texture);
+            }
+
             // READ FRAME //
 
+            int cpu_phase = 0;
+            // recordings take the oled image from the fused pass, which
+            // then also runs without FUSED_OUTPUT
+            int record = capture_recording();
+            int oled_pass = FUSED_OUTPUT || record;
 #if enable_ffmpeg
             // Read a new frame and load it into texture
             if (vid != 0) {
-                glActiveTexture(GL_TEXTURE7);
-                glBindTexture(GL_TEXTURE_2D, vid_depth);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, vid_width, vid_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, vid_depth_frames[vid_curr_frame]);
+                cpu_phase = CPU_PHASE_MASK;
+                if (cpu_phase) {
+                    phase_update(&g->phase, SLM_WIDTH, SLM_HEIGHT,
+                        vid_depth_frames[vid_curr_frame],
+                        vid_width, vid_height);
+                    upload_phase(phase_texture);
+                }
+                if (!cpu_phase || record) {
+                    glActiveTexture(GL_TEXTURE7);
+                    glBindTexture(GL_TEXTURE_2D, vid_depth);
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, vid_width, vid_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, vid_depth_frames[vid_curr_frame]);
+                }
+                if (oled_pass) {
+                    glActiveTexture(GL_TEXTURE8);
+                    glBindTexture(GL_TEXTURE_2D, vid_color);
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, vid_width, vid_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, vid_color_frames[vid_curr_frame]);
+                }
             }
 #endif
 
@@ -3224,22 +4087,98 @@ int main(int argc, char **argv) {
 
             float matrix[16];
             mat_ortho(matrix, 0.0, 1.0, 1.0, 0.0, 0, 1.0);
-            glUseProgram(depth_attrib.program);
-            glUniformMatrix4fv(depth_attrib.matrix, 1, GL_FALSE, matrix);
-            if (vid == 0) {
-                glUniform1i(color_attrib.sampler, 5);
-            } else {
-                glUniform1i(color_attrib.sampler, 7);
+            if (oled_pass) {
+                // one pass writes both outputs, the windows only blit
+                glBindFramebuffer(GL_FRAMEBUFFER, output_fbo);
+                glViewport(0, 0, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+                glUseProgram(output_attrib.program);
+                glUniformMatrix4fv(output_attrib.matrix, 1, GL_FALSE, matrix);
+                if (vid == 0) {
+                    glUniform1i(output_attrib.sampler, 4);
+                    glUniform1i(output_attrib.extra1, 9);
+                } else {
+                    glUniform1i(output_attrib.sampler, 8);
+                    glUniform1i(output_attrib.extra1, 7);
+                }
+                glUniform1i(output_attrib.extra2, 12);
+                glUniform1i(output_attrib.extra3,
+                    cpu_phase || !FUSED_OUTPUT);
+                GLfloat *data = malloc_faces(4, 1);
+                memcpy(data, vertices, sizeof(vertices));
+                GLuint output_buffer = gen_faces(4, 1, data);
+                draw_triangles_2d(&output_attrib, output_buffer, 6);
+                del_buffer(output_buffer);
+                if (FUSED_OUTPUT) {
+                    output_fence =
+                        glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    glFlush();
+                }
+
+                if (FUSED_OUTPUT && !cpu_phase) {
+                    glBindFramebuffer(GL_READ_FRAMEBUFFER, output_fbo);
+                    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                    glBlitFramebuffer(
+                        0, 0, SLM_WIDTH, SLM_HEIGHT,
+                        0, 0, g->width, g->height,
+                        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                }
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                glViewport(0, 0, g->width, g->height);
+            }
+            if (!FUSED_OUTPUT && !cpu_phase) {
+                glUseProgram(depth_attrib.program);
+                glUniformMatrix4fv(depth_attrib.matrix, 1, GL_FALSE, matrix);
+                if (vid == 0) {
+                    glUniform1i(color_attrib.sampler, 9);
+                } else {
+                    glUniform1i(color_attrib.sampler, 7);
+                }
+                glUniform1i(depth_attrib.extra1, vid);
+                GLfloat *data = malloc_faces(4, 1);
+                memcpy(data, vertices, sizeof(vertices));
+                GLuint depth_buffer = gen_faces(4, 1, data);
+                draw_text(&depth_attrib, depth_buffer, 1);
+                del_buffer(depth_buffer);
+            }
+            if (cpu_phase) {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, phase_fbo);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                glBlitFramebuffer(
+                    0, 0, SLM_WIDTH, SLM_HEIGHT, 0, 0, g->width, g->height,
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
             }
-            glUniform1i(depth_attrib.extra1, vid);
-            GLfloat *data = malloc_faces(4, 1);
-            memcpy(data, vertices, sizeof(vertices));
-            GLuint depth_buffer = gen_faces(4, 1, data);
-            draw_text(&depth_attrib, depth_buffer, 1);
-            del_buffer(depth_buffer);
 
             glEnable(GL_CULL_FACE);
 
+            // CAPTURE FRAME //
+            capture_poll();
+            if (record) {
+                // the presented oled image, the diopters the phase mask
+                // was made from and the slm window
+                CaptureSource sources[3] = {
+                    {CAPTURE_RGB, 0, OLED_SIZE, OLED_SIZE,
+                        output_fbo, GL_COLOR_ATTACHMENT1},
+                    {CAPTURE_DIOPTER, fbo_diopter, WIDTH, HEIGHT},
+                    {CAPTURE_PHASE, 0, g->width, g->height, 0, GL_BACK}
+                };
+                if (vid != 0) {
+                    sources[1].texture = vid_depth;
+                    sources[1].width = vid_width;
+                    sources[1].height = vid_height;
+                }
+                capture_record(monotonic_time(), sources, 3);
+            }
+            if (g->save_img) {
+                capture_texture(
+                    "rgb.png", CAPTURE_RGB, fbo_color, WIDTH, HEIGHT);
+                capture_texture(
+                    "depth.png", CAPTURE_DEPTH, fbo_depth, WIDTH, HEIGHT);
+                capture_framebuffer(
+                    "phase.png", CAPTURE_PHASE, g->width, g->height);
+                g->save_img = 0;
+            }
+
             glfwSwapBuffers(g->window);
 
             // END RENDER FRAMEBUFFER //
@@ -3252,9 +4191,11 @@ int main(int argc, char **argv) {
 
 #if enable_ffmpeg
                 if (vid != 0) {
-                    glActiveTexture(GL_TEXTURE8);
-                    glBindTexture(GL_TEXTURE_2D, vid_color);
-                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, vid_width, vid_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, vid_color_frames[vid_curr_frame]);
+                    if (!oled_pass) {
+                        glActiveTexture(GL_TEXTURE8);
+                        glBindTexture(GL_TEXTURE_2D, vid_color);
+                        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, vid_width, vid_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, vid_color_frames[vid_curr_frame]);
+                    }
 
                     if (!pause) {
                         vid_curr_frame = (vid_curr_frame + 1) % vid_num_frames;
@@ -3268,53 +4209,44 @@ int main(int argc, char **argv) {
                 glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-                glActiveTexture(GL_TEXTURE4);
-                glBindTexture(GL_TEXTURE_2D, fbo_color);
-                //glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, fbo_data);
-
-                glUseProgram(color_attrib.program);
-                glUniformMatrix4fv(color_attrib.matrix, 1, GL_FALSE, matrix);
-                if (vid == 0) {
-                    glUniform1i(color_attrib.sampler, 4);
-                } else {
-                    glUniform1i(color_attrib.sampler, 8);
+                if (FUSED_OUTPUT) {
+                    int width, height;
+                    glfwGetFramebufferSize(g->window2, &width, &height);
+                    glWaitSync(output_fence, 0, GL_TIMEOUT_IGNORED);
+                    glDeleteSync(output_fence);
+                    output_fence = 0;
+                    glBindFramebuffer(GL_READ_FRAMEBUFFER, oled_fbo);
+                    glBlitFramebuffer(
+                        0, 0, OLED_SIZE, OLED_SIZE, 0, 0, width, height,
+                        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                }
+                else {
+                    glActiveTexture(GL_TEXTURE4);
+                    glBindTexture(GL_TEXTURE_2D, fbo_color);
+                    //glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, fbo_data);
+
+                    glUseProgram(color_attrib.program);
+                    glUniformMatrix4fv(color_attrib.matrix, 1, GL_FALSE, matrix);
+                    if (vid == 0) {
+                        glUniform1i(color_attrib.sampler, 4);
+                    } else {
+                        glUniform1i(color_attrib.sampler, 8);
+                    }
+                    glUniform1i(color_attrib.extra1, vid);
+                    glUniform1i(color_attrib.extra2, 12);
+                    GLfloat *data = malloc_faces(4, 1);
+                    memcpy(data, vertices, sizeof(vertices));
+                    GLuint color_buffer = gen_faces(4, 1, data);
+                    draw_text(&color_attrib, color_buffer, 1);
+                    del_buffer(color_buffer);
                 }
-                glUniform1i(color_attrib.extra1, vid);
-                GLfloat *data = malloc_faces(4, 1);
-                memcpy(data, vertices, sizeof(vertices));
-                GLuint color_buffer = gen_faces(4, 1, data);
-                draw_text(&color_attrib, color_buffer, 1);
-                del_buffer(color_buffer);
 
                 glfwSwapBuffers(g->window2);
 
                 // END RENDER FRAMEBUFFER //
             }
 
-            if (g->save_img) {
-              // DOWNLOAD COLOR FRAMEBUFFER
-              unsigned char *fbo_data;
-              fbo_data = malloc(sizeof(unsigned char) * WIDTH * HEIGHT * 4);
-
-              glActiveTexture(GL_TEXTURE4);
-              glBindTexture(GL_TEXTURE_2D, fbo_color);
-              glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, fbo_data);
-
-              save_png_texture("rgb.png", fbo_data, WIDTH, HEIGHT, 0);
-
-              // DOWNLOAD DEPTH FRAMEBUFFER
-              glActiveTexture(GL_TEXTURE5);
-              glBindTexture(GL_TEXTURE_2D, fbo_depth);
-              glGetTexImage(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, GL_SHORT, fbo_data);
-
-              save_png_texture("depth.png", fbo_data, WIDTH, HEIGHT, 1);
-
-              free(fbo_data);
-
-              g->save_img = 0;
-            }
-
-
             glfwPollEvents();
             if (glfwWindowShouldClose(g->window)) {
                 running = 0;
@@ -3339,6 +4271,15 @@ int main(int argc, char **argv) {
         delete_all_players();
     }
 
+    glfwMakeContextCurrent(g->window);
+    stop_recording();
+    capture_free();
+    arena_free();
+    cull_grid_free(&g->cull);
+    wait_workers();
+    world_cache_free();
+    phase_free(&g->phase);
+    cull_boxes_free(&g->chunk_boxes);
     glfwTerminate();
     curl_global_cleanup();
     return 0;
@@ -77,6 +77,52 @@ int map_set(Map *map, int x, int y, int z, int w) {
     return 0;
 }
 
+// sets a vertical span of n blocks starting at y. the x and z hashes are
+// computed once and the table is grown up front, so the inner loop only
+// hashes y and probes
+int map_set_column(Map *map, int x, int y, int z, int n, int w) {
+    if (!w) {
+        int result = 0;
+        for (int i = 0; i < n; i++) {
+            result += map_set(map, x, y + i, z, w);
+        }
+        return result;
+    }
+    while ((map->size + n) * 2 > map->mask) {
+        map_grow(map);
+    }
+    int hxz = hash_int(x) ^ hash_int(z);
+    int result = 0;
+    x -= map->dx;
+    z -= map->dz;
+    for (int i = 0; i < n; i++) {
+        int ey = y + i;
+        unsigned int index = (hxz ^ hash_int(ey)) & map->mask;
+        ey -= map->dy;
+        MapEntry *entry = map->data + index;
+        while (!EMPTY_ENTRY(entry)) {
+            if (entry->e.x == x && entry->e.y == ey && entry->e.z == z) {
+                break;
+            }
+            index = (index + 1) & map->mask;
+            entry = map->data + index;
+        }
+        if (EMPTY_ENTRY(entry)) {
+            entry->e.x = x;
+            entry->e.y = ey;
+            entry->e.z = z;
+            entry->e.w = w;
+            map->size++;
+            result++;
+        }
+        else if (entry->e.w != w) {
+            entry->e.w = w;
+            result++;
+        }
+    }
+    return result;
+}
+
 int map_get(Map *map, int x, int y, int z) {
     unsigned int index = hash(x, y, z) & map->mask;
     x -= map->dx;
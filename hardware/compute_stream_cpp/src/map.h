@@ -40,6 +40,7 @@ void map_free(Map *map);
 void map_copy(Map *dst, Map *src);
 void map_grow(Map *map);
 int map_set(Map *map, int x, int y, int z, int w);
+int map_set_column(Map *map, int x, int y, int z, int n, int w);
 int map_get(Map *map, int x, int y, int z);
 
 #endif
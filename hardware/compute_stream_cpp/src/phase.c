@@ -0,0 +1,170 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "phase.h"
+
+// optics of the prototype, as in depth_fragment.glsl
+#define NOMINAL_A -1.966041
+#define FX -0.0126
+#define FY 0.0001
+#define C0 0.0193
+#define LBDA 530e-09
+#define F0 100e-03
+#define FE 40e-03
+#define SLM_PITCH 3.74e-06
+#define W 4.0
+#define LEVELS 50
+
+static float slope_x[256];
+static float slope_y[256];
+static unsigned char level[256];
+static int tables = 0;
+
+static void make_tables() {
+    // depth texels are quantized to LEVELS steps of the diopter range,
+    // each level is a linear phase ramp with its own slopes
+    for (int i = 0; i < 256; i++) {
+        level[i] = floorf(i / 255.0f * LEVELS);
+    }
+    for (int i = 0; i <= LEVELS; i++) {
+        double diopter = (double)i / LEVELS * W;
+        double scale_y = ((C0 * SLM_PITCH * FE * FE) /
+            (3 * LBDA * F0 * F0 * F0)) * (W / 2 - diopter);
+        double scale_x = scale_y / NOMINAL_A;
+        slope_x[i] = -scale_x / 2 + FX;
+        slope_y[i] = -scale_y / 2 + FY;
+    }
+    tables = 1;
+}
+
+void phase_free(PhaseMask *mask) {
+    free(mask->columns);
+    free(mask->rows);
+    free(mask->levels);
+    free(mask->next);
+    free(mask->phase);
+    free(mask->dirty);
+    memset(mask, 0, sizeof(PhaseMask));
+}
+
+void phase_reset(PhaseMask *mask) {
+    mask->valid = 0;
+}
+
+static void resize(PhaseMask *mask, int width, int height) {
+    phase_free(mask);
+    mask->width = width;
+    mask->height = height;
+    mask->tiles_x = (width + PHASE_TILE_SIZE - 1) / PHASE_TILE_SIZE;
+    mask->tiles_y = (height + PHASE_TILE_SIZE - 1) / PHASE_TILE_SIZE;
+    mask->columns = malloc(sizeof(int) * width);
+    mask->rows = malloc(sizeof(int) * height);
+    mask->phase = malloc(width * height);
+    mask->dirty = malloc(mask->tiles_x * mask->tiles_y);
+}
+
+static void resample(PhaseMask *mask, int depth_width, int depth_height) {
+    // nearest depth texel of every slm column and row, the mask is stored
+    // bottom row first and shows the depth frame upside down as the gpu
+    // pass does
+    for (int x = 0; x < mask->width; x++) {
+        int i = (x + 0.5) / mask->width * depth_width;
+        mask->columns[x] = i < depth_width ? i : depth_width - 1;
+    }
+    for (int y = 0; y < mask->height; y++) {
+        int j = (1 - (y + 0.5) / mask->height) * depth_height;
+        mask->rows[y] = j < depth_height ? j : depth_height - 1;
+    }
+    free(mask->levels);
+    free(mask->next);
+    mask->levels = malloc(depth_width * depth_height);
+    mask->next = malloc(depth_width * depth_height);
+    mask->source_width = depth_width;
+    mask->source_height = depth_height;
+}
+
+static int tile_changed(PhaseMask *mask, int tx, int ty, int tw, int th) {
+    // compares the levels of the depth texels the tile samples, rows are
+    // flipped so the last slm row of the tile samples the lowest one
+    int x0 = mask->columns[tx];
+    int x1 = mask->columns[tx + tw - 1];
+    int y0 = mask->rows[ty + th - 1];
+    int y1 = mask->rows[ty];
+    for (int y = y0; y <= y1; y++) {
+        int offset = y * mask->source_width + x0;
+        if (memcmp(mask->next + offset, mask->levels + offset, x1 - x0 + 1))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void compute_tile(PhaseMask *mask, int tx, int ty, int tw, int th) {
+    for (int y = ty; y < ty + th; y++) {
+        const unsigned char *levels =
+            mask->next + mask->rows[y] * mask->source_width;
+        unsigned char *phase = mask->phase + y * mask->width;
+        float v = mask->height / 2.0f - (y + 0.5f);
+        for (int x = tx; x < tx + tw; x++) {
+            float u = x + 0.5f - mask->width / 2.0f;
+            int l = levels[mask->columns[x]];
+            float value = slope_x[l] * u + slope_y[l] * v;
+            value -= floorf(value);
+            phase[x] = (int)(value * 255 + 0.5f);
+        }
+    }
+}
+
+void phase_tile(
+    PhaseMask *mask, int index, int *x, int *y, int *width, int *height)
+{
+    *x = (index % mask->tiles_x) * PHASE_TILE_SIZE;
+    *y = (index / mask->tiles_x) * PHASE_TILE_SIZE;
+    *width = mask->width - *x < PHASE_TILE_SIZE ?
+        mask->width - *x : PHASE_TILE_SIZE;
+    *height = mask->height - *y < PHASE_TILE_SIZE ?
+        mask->height - *y : PHASE_TILE_SIZE;
+}
+
+int phase_update(
+    PhaseMask *mask, int width, int height,
+    const unsigned char *depth, int depth_width, int depth_height)
+{
+    // depth is an rgba frame whose red channel holds normalized diopters,
+    // returns the number of tiles marked dirty
+    if (!tables) {
+        make_tables();
+    }
+    if (mask->width != width || mask->height != height) {
+        resize(mask, width, height);
+    }
+    if (mask->source_width != depth_width ||
+        mask->source_height != depth_height)
+    {
+        resample(mask, depth_width, depth_height);
+        mask->valid = 0;
+    }
+    int size = depth_width * depth_height;
+    for (int i = 0; i < size; i++) {
+        mask->next[i] = level[depth[i * 4]];
+    }
+    int count = 0;
+    for (int i = 0; i < mask->tiles_x * mask->tiles_y; i++) {
+        int tx, ty, tw, th;
+        phase_tile(mask, i, &tx, &ty, &tw, &th);
+        mask->dirty[i] = !mask->valid || tile_changed(mask, tx, ty, tw, th);
+        if (mask->dirty[i]) {
+            compute_tile(mask, tx, ty, tw, th);
+            count++;
+        }
+    }
+    unsigned char *levels = mask->levels;
+    mask->levels = mask->next;
+    mask->next = levels;
+    mask->valid = 1;
+    mask->updated = count;
+    mask->frames++;
+    mask->total_updated += count;
+    return count;
+}
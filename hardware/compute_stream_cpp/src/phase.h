@@ -0,0 +1,35 @@
+#ifndef _phase_h_
+#define _phase_h_
+
+#define PHASE_TILE_SIZE 64
+
+// phase mask of a video computed on the cpu, only the tiles whose
+// quantized diopter levels changed since the last frame are recomputed
+typedef struct {
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    int source_width;
+    int source_height;
+    int *columns;
+    int *rows;
+    unsigned char *levels;
+    unsigned char *next;
+    unsigned char *phase;
+    unsigned char *dirty;
+    int valid;
+    int updated;
+    unsigned int frames;
+    double total_updated;
+} PhaseMask;
+
+void phase_free(PhaseMask *mask);
+void phase_reset(PhaseMask *mask);
+int phase_update(
+    PhaseMask *mask, int width, int height,
+    const unsigned char *depth, int depth_width, int depth_height);
+void phase_tile(
+    PhaseMask *mask, int index, int *x, int *y, int *width, int *height);
+
+#endif
@@ -0,0 +1,114 @@
+#include <math.h>
+#include "config.h"
+#include "ray.h"
+
+typedef struct {
+    ray_chunk_func func;
+    void *arg;
+    int valid;
+    int p;
+    int q;
+    Map *map;
+} ChunkCache;
+
+static int chunked(int x) {
+    return x >= 0 ? x / CHUNK_SIZE : (x + 1) / CHUNK_SIZE - 1;
+}
+
+static Map *lookup(ChunkCache *cache, int x, int z) {
+    int p = chunked(x);
+    int q = chunked(z);
+    if (!cache->valid || cache->p != p || cache->q != q) {
+        cache->map = cache->func(p, q, cache->arg);
+        cache->p = p;
+        cache->q = q;
+        cache->valid = 1;
+    }
+    return cache->map;
+}
+
+static void setup_axis(
+    float x, float v, int n, int *step, float *next, float *delta)
+{
+    // block n spans [n - 0.5, n + 0.5] on each axis
+    if (v > 0) {
+        *step = 1;
+        *delta = 1 / v;
+        *next = (n + 0.5f - x) / v;
+    }
+    else if (v < 0) {
+        *step = -1;
+        *delta = -1 / v;
+        *next = (n - 0.5f - x) / v;
+    }
+    else {
+        *step = 0;
+        *delta = INFINITY;
+        *next = INFINITY;
+    }
+}
+
+static int cast(Ray *ray, ChunkCache *cache, RayHit *hit) {
+    // amanatides-woo traversal: visits every block the ray passes through
+    // in order, one block per step
+    int nx = roundf(ray->x);
+    int ny = roundf(ray->y);
+    int nz = roundf(ray->z);
+    int sx, sy, sz;
+    float tx, ty, tz;
+    float dx, dy, dz;
+    setup_axis(ray->x, ray->vx, nx, &sx, &tx, &dx);
+    setup_axis(ray->y, ray->vy, ny, &sy, &ty, &dy);
+    setup_axis(ray->z, ray->vz, nz, &sz, &tz, &dz);
+    int px = nx;
+    int py = ny;
+    int pz = nz;
+    float t = 0;
+    hit->w = 0;
+    while (t <= ray->max_distance) {
+        if (ny >= 0 && ny < 256) {
+            Map *map = lookup(cache, nx, nz);
+            int w = map ? map_get(map, nx, ny, nz) : 0;
+            if (w > 0) {
+                hit->w = w;
+                hit->x = nx; hit->y = ny; hit->z = nz;
+                hit->px = px; hit->py = py; hit->pz = pz;
+                hit->distance = t;
+                return w;
+            }
+        }
+        else if ((ny < 0 && sy <= 0) || (ny >= 256 && sy >= 0)) {
+            break;
+        }
+        px = nx; py = ny; pz = nz;
+        if (tx < ty && tx < tz) {
+            t = tx; tx += dx; nx += sx;
+        }
+        else if (ty < tz) {
+            t = ty; ty += dy; ny += sy;
+        }
+        else {
+            t = tz; tz += dz; nz += sz;
+        }
+    }
+    return 0;
+}
+
+int ray_cast(Ray *ray, ray_chunk_func func, void *arg, RayHit *hit) {
+    ChunkCache cache = {func, arg, 0, 0, 0, 0};
+    return cast(ray, &cache, hit);
+}
+
+int ray_cast_batch(
+    Ray *rays, int count, ray_chunk_func func, void *arg, RayHit *hits)
+{
+    // the chunk cache is shared, so nearby rays rarely repeat a lookup
+    ChunkCache cache = {func, arg, 0, 0, 0, 0};
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+        if (cast(rays + i, &cache, hits + i)) {
+            result++;
+        }
+    }
+    return result;
+}
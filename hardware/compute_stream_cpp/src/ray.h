@@ -0,0 +1,26 @@
+#ifndef _ray_h_
+#define _ray_h_
+
+#include "map.h"
+
+// returns the block map of chunk (p, q) or 0 if it is not loaded
+typedef Map *(*ray_chunk_func)(int p, int q, void *arg);
+
+typedef struct {
+    float x, y, z;
+    float vx, vy, vz;
+    float max_distance;
+} Ray;
+
+typedef struct {
+    int w;
+    int x, y, z;
+    int px, py, pz;
+    float distance;
+} RayHit;
+
+int ray_cast(Ray *ray, ray_chunk_func func, void *arg, RayHit *hit);
+int ray_cast_batch(
+    Ray *rays, int count, ray_chunk_func func, void *arg, RayHit *hits);
+
+#endif
@@ -1,3 +1,10 @@
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #define _POSIX_C_SOURCE 200112L
+    #include <time.h>
+#endif
+
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,14 +23,40 @@ double rand_double() {
     return (double)rand() / (double)RAND_MAX;
 }
 
+double monotonic_time() {
+    // unlike glfwGetTime this is not reset when the server sets the time
+    // of day
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
 void update_fps(FPS *fps) {
     fps->frames++;
     double now = glfwGetTime();
+    if (fps->last > 0 && fps->fps) {
+        // a hitch is a frame taking over twice the last second's average
+        double frame = now - fps->last;
+        if (frame > 2.0 / fps->fps) {
+            fps->hitches++;
+        }
+        fps->slowest = MAX(fps->slowest, frame);
+    }
+    fps->last = now;
     double elapsed = now - fps->since;
     if (elapsed >= 1) {
         fps->fps = round(fps->frames / elapsed);
         fps->frames = 0;
         fps->since = now;
+        fps->worst = fps->slowest;
+        fps->slowest = 0;
     }
 }
 
@@ -42,16 +75,124 @@ char *load_file(const char *path) {
     return data;
 }
 
+// buffers passed to del_buffer are kept by power of two size class and
+// handed out again by gen_buffer instead of deleting and generating names
+
+#define POOL_CLASSES 16
+#define POOL_DEPTH 64
+#define POOL_MIN_SIZE 256
+#define POOL_MAX_BYTES (64 * 1024 * 1024)
+
+static GLuint pool[POOL_CLASSES][POOL_DEPTH];
+static int pool_count[POOL_CLASSES];
+static int pool_bytes;
+
+// size class of every pooled buffer handed out, keyed by buffer name
+static GLuint *live_keys;
+static unsigned char *live_classes;
+static unsigned int live_mask;
+static unsigned int live_count;
+
+static unsigned int live_hash(GLuint buffer) {
+    return (buffer * 2654435761u) & live_mask;
+}
+
+static void live_put(GLuint buffer, int size_class) {
+    if ((live_count + 1) * 2 > live_mask + 1) {
+        GLuint *keys = live_keys;
+        unsigned char *classes = live_classes;
+        unsigned int capacity = live_keys ? live_mask + 1 : 0;
+        live_mask = capacity ? capacity * 2 - 1 : 255;
+        live_keys = calloc(live_mask + 1, sizeof(GLuint));
+        live_classes = calloc(live_mask + 1, sizeof(unsigned char));
+        live_count = 0;
+        for (unsigned int i = 0; i < capacity; i++) {
+            if (keys[i]) {
+                live_put(keys[i], classes[i]);
+            }
+        }
+        free(keys);
+        free(classes);
+    }
+    unsigned int i = live_hash(buffer);
+    while (live_keys[i]) {
+        i = (i + 1) & live_mask;
+    }
+    live_keys[i] = buffer;
+    live_classes[i] = size_class;
+    live_count++;
+}
+
+static int live_take(GLuint buffer) {
+    if (!live_count) {
+        return -1;
+    }
+    unsigned int i = live_hash(buffer);
+    while (live_keys[i] != buffer) {
+        if (!live_keys[i]) {
+            return -1;
+        }
+        i = (i + 1) & live_mask;
+    }
+    int size_class = live_classes[i];
+    // shift later entries of the probe sequence back into the hole
+    unsigned int j = i;
+    while (live_keys[j = (j + 1) & live_mask]) {
+        unsigned int k = live_hash(live_keys[j]);
+        if (((j - k) & live_mask) >= ((j - i) & live_mask)) {
+            live_keys[i] = live_keys[j];
+            live_classes[i] = live_classes[j];
+            i = j;
+        }
+    }
+    live_keys[i] = 0;
+    live_count--;
+    return size_class;
+}
+
 GLuint gen_buffer(GLsizei size, GLfloat *data) {
+    int size_class = 0;
+    while (size_class < POOL_CLASSES &&
+        (POOL_MIN_SIZE << size_class) < size)
+    {
+        size_class++;
+    }
     GLuint buffer;
-    glGenBuffers(1, &buffer);
+    if (size_class < POOL_CLASSES && pool_count[size_class]) {
+        buffer = pool[size_class][--pool_count[size_class]];
+        pool_bytes -= POOL_MIN_SIZE << size_class;
+    }
+    else {
+        glGenBuffers(1, &buffer);
+    }
     glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+    if (size_class < POOL_CLASSES) {
+        // respecifying the whole store orphans the old contents, so the
+        // upload never waits on a draw still reading them
+        glBufferData(GL_ARRAY_BUFFER, POOL_MIN_SIZE << size_class, 0,
+            GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+        live_put(buffer, size_class);
+    }
+    else {
+        glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+    }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     return buffer;
 }
 
 void del_buffer(GLuint buffer) {
+    if (!buffer) {
+        return;
+    }
+    int size_class = live_take(buffer);
+    if (size_class >= 0 && pool_count[size_class] < POOL_DEPTH &&
+        pool_bytes + (POOL_MIN_SIZE << size_class) <= POOL_MAX_BYTES)
+    {
+        pool[size_class][pool_count[size_class]++] = buffer;
+        pool_bytes += POOL_MIN_SIZE << size_class;
+        return;
+    }
     glDeleteBuffers(1, &buffer);
 }
 
@@ -175,6 +316,100 @@ char *tokenize(char *str, const char *delim, char **key) {
     return result;
 }
 
+// reads one comma terminated field, returning a pointer past the comma
+// (or to the terminating null) or NULL if the field is not a number
+const char *scan_int(const char *str, int *value) {
+    int sign = 1;
+    int result = 0;
+    if (*str == '-') {
+        sign = -1;
+        str++;
+    }
+    if (*str < '0' || *str > '9') {
+        return NULL;
+    }
+    while (*str >= '0' && *str <= '9') {
+        result = result * 10 + (*str++ - '0');
+    }
+    if (*str != ',' && *str != '\0') {
+        return NULL;
+    }
+    *value = result * sign;
+    return *str ? str + 1 : str;
+}
+
+const char *scan_double(const char *str, double *value) {
+    double sign = 1;
+    double result = 0;
+    int digits = 0;
+    int exponent = 0;
+    if (*str == '-') {
+        sign = -1;
+        str++;
+    }
+    for (; *str >= '0' && *str <= '9'; str++, digits++) {
+        result = result * 10 + (*str - '0');
+    }
+    if (*str == '.') {
+        for (str++; *str >= '0' && *str <= '9'; str++, digits++) {
+            result = result * 10 + (*str - '0');
+            exponent--;
+        }
+    }
+    if (!digits) {
+        return NULL;
+    }
+    if (*str == 'e' || *str == 'E') {
+        // printf writes positive exponents with a '+'
+        int power;
+        str++;
+        if (*str == '+') {
+            str++;
+            if (*str == '-') {
+                return NULL;
+            }
+        }
+        if (!(str = scan_int(str, &power))) {
+            return NULL;
+        }
+        exponent += power;
+    }
+    else if (*str == ',') {
+        str++;
+    }
+    else if (*str != '\0') {
+        return NULL;
+    }
+    if (exponent < 0) {
+        result /= pow(10, -exponent);
+    }
+    else if (exponent > 0) {
+        result *= pow(10, exponent);
+    }
+    *value = sign * result;
+    return str;
+}
+
+int scan_ints(const char *str, int *values, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!str || !(str = scan_int(str, values + i))) {
+            return i;
+        }
+    }
+    return count;
+}
+
+int scan_floats(const char *str, float *values, int count) {
+    double value;
+    for (int i = 0; i < count; i++) {
+        if (!str || !(str = scan_double(str, &value))) {
+            return i;
+        }
+        values[i] = value;
+    }
+    return count;
+}
+
 int char_width(char input) {
     static const int lookup[128] = {
         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -24,10 +24,15 @@ typedef struct {
     unsigned int fps;
     unsigned int frames;
     double since;
+    double last;
+    unsigned int hitches;
+    double worst;
+    double slowest;
 } FPS;
 
 int rand_int(int n);
 double rand_double();
+double monotonic_time();
 void update_fps(FPS *fps);
 
 GLuint gen_buffer(GLsizei size, GLfloat *data);
@@ -41,6 +46,10 @@ GLuint load_program(const char *path1, const char *path2);
 void save_png_texture(char *file_name, unsigned char *data, unsigned int width, unsigned int height, int bitdepth);
 void load_png_texture(const char *file_name);
 char *tokenize(char *str, const char *delim, char **key);
+const char *scan_int(const char *str, int *value);
+const char *scan_double(const char *str, double *value);
+int scan_ints(const char *str, int *values, int count);
+int scan_floats(const char *str, float *values, int count);
 int char_width(char input);
 int string_width(const char *input);
 int wrap(const char *input, int max_width, char *output, int max_length);
@@ -0,0 +1,385 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "tinycthread.h"
+#include "warp.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WARP_AVX2 1
+#include <immintrin.h>
+#else
+#define WARP_AVX2 0
+#endif
+
+#define TILE_SIZE 64
+#define MAX_THREADS 64
+
+// the calibration in single precision, as used per pixel
+typedef struct {
+    float h[9];
+    float cx, cy;
+    float fx, fy;
+    float ifx, ify;
+    float k[5];
+    int distorted;
+} Mapping;
+
+typedef struct {
+    const Mapping *mapping;
+    const unsigned char *src;
+    int slm_width;
+    int slm_height;
+    unsigned char *dst;
+    int size;
+    int index;
+    int count;
+} Job;
+
+static void make_mapping(const Calibration *calib, Mapping *mapping) {
+    for (int i = 0; i < 9; i++) {
+        mapping->h[i] = calib->homography[i];
+    }
+    mapping->cx = calib->center[0];
+    mapping->cy = calib->center[1];
+    mapping->fx = calib->focal[0];
+    mapping->fy = calib->focal[1];
+    mapping->ifx = 1 / calib->focal[0];
+    mapping->ify = 1 / calib->focal[1];
+    mapping->distorted = 0;
+    for (int i = 0; i < 5; i++) {
+        mapping->k[i] = calib->distortion[i];
+        mapping->distorted |= calib->distortion[i] != 0;
+    }
+}
+
+static uint32_t sample(
+    const unsigned char *src, int width, int height, float u, float v)
+{
+    // bilinear filtering with texel centers at +0.5 and clamped taps,
+    // as gl_linear does for the colour texture
+    if (!(u >= 0 && u <= width && v >= 0 && v <= height)) {
+        return 0xff000000;
+    }
+    float sx = u - 0.5f;
+    float sy = v - 0.5f;
+    float x0f = floorf(sx);
+    float y0f = floorf(sy);
+    float ax = sx - x0f;
+    float ay = sy - y0f;
+    int x0 = x0f;
+    int y0 = y0f;
+    int x1 = x0 + 1;
+    int y1 = y0 + 1;
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 > width - 1 ? width - 1 : x1;
+    y1 = y1 > height - 1 ? height - 1 : y1;
+    const unsigned char *p00 = src + (y0 * width + x0) * 4;
+    const unsigned char *p10 = src + (y0 * width + x1) * 4;
+    const unsigned char *p01 = src + (y1 * width + x0) * 4;
+    const unsigned char *p11 = src + (y1 * width + x1) * 4;
+    uint32_t result = 0xff000000;
+    for (int c = 0; c < 3; c++) {
+        float top = p00[c] + (p10[c] - p00[c]) * ax;
+        float bottom = p01[c] + (p11[c] - p01[c]) * ax;
+        float value = top + (bottom - top) * ay;
+        result |= (uint32_t)(int)(value + 0.5f) << (8 * c);
+    }
+    return result;
+}
+
+static int map_pixel(const Mapping *m, float x, float y, float *u, float *v)
+{
+    if (m->distorted) {
+        float a = (x - m->cx) * m->ifx;
+        float b = (y - m->cy) * m->ify;
+        float r2 = a * a + b * b;
+        float radial = 1 + r2 * (m->k[0] + r2 * (m->k[1] + r2 * m->k[4]));
+        float da = a * radial + 2 * m->k[2] * a * b +
+            m->k[3] * (r2 + 2 * a * a);
+        float db = b * radial + m->k[2] * (r2 + 2 * b * b) +
+            2 * m->k[3] * a * b;
+        x = da * m->fx + m->cx;
+        y = db * m->fy + m->cy;
+    }
+    float w = m->h[6] * x + m->h[7] * y + m->h[8];
+    if (!(w > 0)) {
+        return 0;
+    }
+    *u = (m->h[0] * x + m->h[1] * y + m->h[2]) / w;
+    *v = (m->h[3] * x + m->h[4] * y + m->h[5]) / w;
+    return 1;
+}
+
+static void warp_span(
+    const Mapping *m, const unsigned char *src, int width, int height,
+    uint32_t *dst, int x, int y, int count)
+{
+    for (int i = 0; i < count; i++) {
+        float u, v;
+        if (map_pixel(m, x + i + 0.5f, y + 0.5f, &u, &v)) {
+            dst[i] = sample(src, width, height, u, v);
+        }
+        else {
+            dst[i] = 0xff000000;
+        }
+    }
+}
+
+#if WARP_AVX2
+
+#define AVX2 __attribute__((target("avx2,fma")))
+
+AVX2 static __m256 channel(__m256i pixels, int c) {
+    __m256i value = _mm256_srli_epi32(pixels, 8 * c);
+    value = _mm256_and_si256(value, _mm256_set1_epi32(0xff));
+    return _mm256_cvtepi32_ps(value);
+}
+
+AVX2 static void warp_span8(
+    const Mapping *m, const unsigned char *src, int width, int height,
+    uint32_t *dst, int x, int y)
+{
+    // the same arithmetic as map_pixel and sample for eight pixels of a
+    // row, the four taps of each are gathered as whole rgba texels
+    const int *texels = (const int *)src;
+    __m256 px = _mm256_add_ps(
+        _mm256_set1_ps(x + 0.5f),
+        _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256 py = _mm256_set1_ps(y + 0.5f);
+    if (m->distorted) {
+        __m256 a = _mm256_mul_ps(
+            _mm256_sub_ps(px, _mm256_set1_ps(m->cx)),
+            _mm256_set1_ps(m->ifx));
+        __m256 b = _mm256_mul_ps(
+            _mm256_sub_ps(py, _mm256_set1_ps(m->cy)),
+            _mm256_set1_ps(m->ify));
+        __m256 r2 = _mm256_add_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+        __m256 radial = _mm256_add_ps(_mm256_set1_ps(m->k[1]),
+            _mm256_mul_ps(r2, _mm256_set1_ps(m->k[4])));
+        radial = _mm256_add_ps(_mm256_set1_ps(m->k[0]),
+            _mm256_mul_ps(r2, radial));
+        radial = _mm256_add_ps(_mm256_set1_ps(1),
+            _mm256_mul_ps(r2, radial));
+        __m256 ab = _mm256_mul_ps(a, b);
+        __m256 two = _mm256_set1_ps(2);
+        __m256 da = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(a, radial),
+                _mm256_mul_ps(_mm256_set1_ps(2 * m->k[2]), ab)),
+            _mm256_mul_ps(_mm256_set1_ps(m->k[3]),
+                _mm256_add_ps(r2, _mm256_mul_ps(two, _mm256_mul_ps(a, a)))));
+        __m256 db = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(b, radial),
+                _mm256_mul_ps(_mm256_set1_ps(m->k[2]),
+                    _mm256_add_ps(r2,
+                        _mm256_mul_ps(two, _mm256_mul_ps(b, b))))),
+            _mm256_mul_ps(_mm256_set1_ps(2 * m->k[3]), ab));
+        px = _mm256_add_ps(
+            _mm256_mul_ps(da, _mm256_set1_ps(m->fx)), _mm256_set1_ps(m->cx));
+        py = _mm256_add_ps(
+            _mm256_mul_ps(db, _mm256_set1_ps(m->fy)), _mm256_set1_ps(m->cy));
+    }
+    __m256 w = _mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(_mm256_set1_ps(m->h[6]), px),
+        _mm256_mul_ps(_mm256_set1_ps(m->h[7]), py)),
+        _mm256_set1_ps(m->h[8]));
+    __m256 u = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(_mm256_set1_ps(m->h[0]), px),
+        _mm256_mul_ps(_mm256_set1_ps(m->h[1]), py)),
+        _mm256_set1_ps(m->h[2])), w);
+    __m256 v = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(_mm256_set1_ps(m->h[3]), px),
+        _mm256_mul_ps(_mm256_set1_ps(m->h[4]), py)),
+        _mm256_set1_ps(m->h[5])), w);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 valid = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(w, zero, _CMP_GT_OQ),
+            _mm256_cmp_ps(u, zero, _CMP_GE_OQ)),
+        _mm256_and_ps(
+            _mm256_cmp_ps(u, _mm256_set1_ps(width), _CMP_LE_OQ),
+            _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ),
+                _mm256_cmp_ps(v, _mm256_set1_ps(height), _CMP_LE_OQ))));
+    if (_mm256_movemask_ps(valid) == 0) {
+        _mm256_storeu_si256((__m256i *)dst, _mm256_set1_epi32(0xff000000));
+        return;
+    }
+    // invalid lanes sample texel 0 and are masked off below
+    u = _mm256_blendv_ps(_mm256_set1_ps(0.5f), u, valid);
+    v = _mm256_blendv_ps(_mm256_set1_ps(0.5f), v, valid);
+    __m256 sx = _mm256_sub_ps(u, _mm256_set1_ps(0.5f));
+    __m256 sy = _mm256_sub_ps(v, _mm256_set1_ps(0.5f));
+    __m256 x0f = _mm256_floor_ps(sx);
+    __m256 y0f = _mm256_floor_ps(sy);
+    __m256 ax = _mm256_sub_ps(sx, x0f);
+    __m256 ay = _mm256_sub_ps(sy, y0f);
+    __m256i x0 = _mm256_cvttps_epi32(x0f);
+    __m256i y0 = _mm256_cvttps_epi32(y0f);
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i x1 = _mm256_min_epi32(
+        _mm256_add_epi32(x0, one), _mm256_set1_epi32(width - 1));
+    __m256i y1 = _mm256_min_epi32(
+        _mm256_add_epi32(y0, one), _mm256_set1_epi32(height - 1));
+    x0 = _mm256_max_epi32(x0, _mm256_setzero_si256());
+    y0 = _mm256_max_epi32(y0, _mm256_setzero_si256());
+    __m256i row0 = _mm256_mullo_epi32(y0, _mm256_set1_epi32(width));
+    __m256i row1 = _mm256_mullo_epi32(y1, _mm256_set1_epi32(width));
+    __m256i p00 = _mm256_i32gather_epi32(
+        texels, _mm256_add_epi32(row0, x0), 4);
+    __m256i p10 = _mm256_i32gather_epi32(
+        texels, _mm256_add_epi32(row0, x1), 4);
+    __m256i p01 = _mm256_i32gather_epi32(
+        texels, _mm256_add_epi32(row1, x0), 4);
+    __m256i p11 = _mm256_i32gather_epi32(
+        texels, _mm256_add_epi32(row1, x1), 4);
+    __m256i result = _mm256_set1_epi32(0xff000000);
+    for (int c = 0; c < 3; c++) {
+        __m256 c00 = channel(p00, c);
+        __m256 c10 = channel(p10, c);
+        __m256 c01 = channel(p01, c);
+        __m256 c11 = channel(p11, c);
+        __m256 top = _mm256_add_ps(c00,
+            _mm256_mul_ps(_mm256_sub_ps(c10, c00), ax));
+        __m256 bottom = _mm256_add_ps(c01,
+            _mm256_mul_ps(_mm256_sub_ps(c11, c01), ax));
+        __m256 value = _mm256_add_ps(top,
+            _mm256_mul_ps(_mm256_sub_ps(bottom, top), ay));
+        __m256i byte = _mm256_cvttps_epi32(
+            _mm256_add_ps(value, _mm256_set1_ps(0.5f)));
+        result = _mm256_or_si256(result, _mm256_slli_epi32(byte, 8 * c));
+    }
+    result = _mm256_blendv_epi8(_mm256_set1_epi32(0xff000000), result,
+        _mm256_castps_si256(valid));
+    _mm256_storeu_si256((__m256i *)dst, result);
+}
+
+AVX2 static void warp_tile_avx2(Job *job, int tx, int ty) {
+    int x1 = tx + TILE_SIZE < job->size ? tx + TILE_SIZE : job->size;
+    int y1 = ty + TILE_SIZE < job->size ? ty + TILE_SIZE : job->size;
+    for (int y = ty; y < y1; y++) {
+        uint32_t *row = (uint32_t *)job->dst + (size_t)y * job->size;
+        int x = tx;
+        for (; x + 8 <= x1; x += 8) {
+            warp_span8(job->mapping, job->src, job->slm_width,
+                job->slm_height, row + x, x, y);
+        }
+        warp_span(job->mapping, job->src, job->slm_width, job->slm_height,
+            row + x, x, y, x1 - x);
+    }
+}
+
+#endif
+
+int warp_simd() {
+#if WARP_AVX2
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return 0;
+#endif
+}
+
+static void warp_tile(Job *job, int tx, int ty) {
+    int x1 = tx + TILE_SIZE < job->size ? tx + TILE_SIZE : job->size;
+    int y1 = ty + TILE_SIZE < job->size ? ty + TILE_SIZE : job->size;
+    for (int y = ty; y < y1; y++) {
+        uint32_t *row = (uint32_t *)job->dst + (size_t)y * job->size;
+        warp_span(job->mapping, job->src, job->slm_width, job->slm_height,
+            row + tx, tx, y, x1 - tx);
+    }
+}
+
+static int warp_run(void *arg) {
+    // the homography is close to a quarter turn, so rows of the oled walk
+    // columns of the slm image, square tiles keep the taps of neighbouring
+    // rows in cache, threads take every count-th tile
+    Job *job = (Job *)arg;
+    int tiles = (job->size + TILE_SIZE - 1) / TILE_SIZE;
+    int simd = warp_simd();
+    for (int i = job->index; i < tiles * tiles; i += job->count) {
+        int tx = (i % tiles) * TILE_SIZE;
+        int ty = (i / tiles) * TILE_SIZE;
+#if WARP_AVX2
+        if (simd) {
+            warp_tile_avx2(job, tx, ty);
+            continue;
+        }
+#endif
+        warp_tile(job, tx, ty);
+    }
+    (void)simd;
+    return 0;
+}
+
+void warp_fit(
+    const unsigned char *src, int width, int height, int channels,
+    unsigned char *dst, int slm_width, int slm_height)
+{
+    // larger images are cropped around the center, smaller ones padded
+    // with zeros with the odd pixel going to the bottom and right
+    int oy = height > slm_height ?
+        (height - slm_height) / 2 : -((slm_height - height) / 2);
+    int ox = width > slm_width ?
+        (width - slm_width) / 2 : -((slm_width - width) / 2);
+    for (int y = 0; y < slm_height; y++) {
+        unsigned char *row = dst + (size_t)y * slm_width * channels;
+        int fy = y + oy;
+        if (fy < 0 || fy >= height) {
+            memset(row, 0, (size_t)slm_width * channels);
+            continue;
+        }
+        const unsigned char *flipped =
+            src + (size_t)(height - 1 - fy) * width * channels;
+        for (int x = 0; x < slm_width; x++) {
+            int fx = x + ox;
+            if (fx < 0 || fx >= width) {
+                memset(row + x * channels, 0, channels);
+            }
+            else {
+                memcpy(row + x * channels,
+                    flipped + (width - 1 - fx) * channels, channels);
+            }
+        }
+    }
+}
+
+void warp_oled(
+    const Calibration *calib, const unsigned char *src,
+    int slm_width, int slm_height, unsigned char *dst, int size,
+    int threads)
+{
+    Mapping mapping;
+    Job jobs[MAX_THREADS];
+    thrd_t thrds[MAX_THREADS];
+    make_mapping(calib, &mapping);
+    threads = threads < 1 ? 1 : threads;
+    threads = threads > MAX_THREADS ? MAX_THREADS : threads;
+    for (int i = 0; i < threads; i++) {
+        Job job = {
+            &mapping, src, slm_width, slm_height, dst, size, i, threads};
+        jobs[i] = job;
+    }
+    for (int i = 1; i < threads; i++) {
+        thrd_create(thrds + i, warp_run, jobs + i);
+    }
+    warp_run(jobs);
+    for (int i = 1; i < threads; i++) {
+        thrd_join(thrds[i], NULL);
+    }
+}
+
+void warp_oled_reference(
+    const Calibration *calib, const unsigned char *src,
+    int slm_width, int slm_height, unsigned char *dst, int size)
+{
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            uint32_t *pixel = (uint32_t *)dst + (size_t)y * size + x;
+            double u, v;
+            if (calib_map(calib, x + 0.5, y + 0.5, &u, &v)) {
+                *pixel = sample(src, slm_width, slm_height, u, v);
+            }
+            else {
+                *pixel = 0xff000000;
+            }
+        }
+    }
+}
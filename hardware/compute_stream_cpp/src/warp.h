@@ -0,0 +1,30 @@
+#ifndef _warp_h_
+#define _warp_h_
+
+#include "calib.h"
+
+// cpu version of the oled pass for batch conversion without a gl context
+
+// flips both axes and crops or pads around the center to the slm size,
+// as fit_images in compute.py, pixels have channels bytes each
+void warp_fit(
+    const unsigned char *src, int width, int height, int channels,
+    unsigned char *dst, int slm_width, int slm_height);
+
+// warps an rgba slm image onto a size x size rgba oled image, oled pixels
+// outside of the slm image are black, rows are stored in the order of
+// the calibration y and v coordinates
+void warp_oled(
+    const Calibration *calib, const unsigned char *src,
+    int slm_width, int slm_height, unsigned char *dst, int size,
+    int threads);
+
+// scalar version mapping every pixel with calib_map, for validation
+void warp_oled_reference(
+    const Calibration *calib, const unsigned char *src,
+    int slm_width, int slm_height, unsigned char *dst, int size);
+
+// 1 if warp_oled uses avx2 on this cpu
+int warp_simd();
+
+#endif
@@ -2,18 +2,71 @@
 #include "noise.h"
 #include "world.h"
 
-void create_world(int p, int q, world_func func, void *arg) {
-    int pad = 1;
-    for (int dx = -pad; dx < CHUNK_SIZE + pad; dx++) {
-        for (int dz = -pad; dz < CHUNK_SIZE + pad; dz++) {
+#define PAD 1
+#define ROW (CHUNK_SIZE + PAD * 2)
+#define CLOUD_BOTTOM 64
+#define CLOUD_TOP 72
+
+void create_world_runs(int p, int q, world_run_func func, void *arg) {
+    // noise is evaluated a row of columns at a time with the batch
+    // functions, which return the same values as per-column calls
+    float ax[ROW], az[ROW], nx[ROW], nz[ROW], cy[ROW];
+    float height[ROW], mountain[ROW], grass[ROW], flower[ROW];
+    float flower_type[ROW], tree[ROW];
+    float cloud[CLOUD_TOP - CLOUD_BOTTOM][ROW];
+    for (int dx = -PAD; dx < CHUNK_SIZE + PAD; dx++) {
+        int x = p * CHUNK_SIZE + dx;
+        for (int i = 0; i < ROW; i++) {
+            int z = q * CHUNK_SIZE + i - PAD;
+            ax[i] = x * 0.01; az[i] = z * 0.01;
+            nx[i] = -x * 0.01; nz[i] = -z * 0.01;
+        }
+        simplex2_batch(ax, az, height, ROW, 4, 0.5, 2);
+        simplex2_batch(nx, nz, mountain, ROW, 2, 0.9, 2);
+        if (SHOW_PLANTS) {
+            for (int i = 0; i < ROW; i++) {
+                int z = q * CHUNK_SIZE + i - PAD;
+                nx[i] = -x * 0.1; az[i] = z * 0.1;
+            }
+            simplex2_batch(nx, az, grass, ROW, 4, 0.8, 2);
+            for (int i = 0; i < ROW; i++) {
+                int z = q * CHUNK_SIZE + i - PAD;
+                ax[i] = x * 0.05; nz[i] = -z * 0.05;
+            }
+            simplex2_batch(ax, nz, flower, ROW, 4, 0.8, 2);
+            for (int i = 0; i < ROW; i++) {
+                ax[i] = x * 0.1;
+            }
+            simplex2_batch(ax, az, flower_type, ROW, 4, 0.8, 2);
+        }
+        if (SHOW_TREES) {
+            for (int i = 0; i < ROW; i++) {
+                ax[i] = x; az[i] = q * CHUNK_SIZE + i - PAD;
+            }
+            simplex2_batch(ax, az, tree, ROW, 6, 0.5, 2);
+        }
+        if (SHOW_CLOUDS) {
+            for (int i = 0; i < ROW; i++) {
+                int z = q * CHUNK_SIZE + i - PAD;
+                ax[i] = x * 0.01; az[i] = z * 0.01;
+            }
+            for (int y = CLOUD_BOTTOM; y < CLOUD_TOP; y++) {
+                for (int i = 0; i < ROW; i++) {
+                    cy[i] = y * 0.1;
+                }
+                simplex3_batch(
+                    ax, cy, az, cloud[y - CLOUD_BOTTOM], ROW, 8, 0.5, 2);
+            }
+        }
+        for (int dz = -PAD; dz < CHUNK_SIZE + PAD; dz++) {
+            int i = dz + PAD;
             int flag = 1;
             if (dx < 0 || dz < 0 || dx >= CHUNK_SIZE || dz >= CHUNK_SIZE) {
                 flag = -1;
             }
-            int x = p * CHUNK_SIZE + dx;
             int z = q * CHUNK_SIZE + dz;
-            float f = simplex2(x * 0.01, z * 0.01, 4, 0.5, 2);
-            float g = simplex2(-x * 0.01, -z * 0.01, 2, 0.9, 2);
+            float f = height[i];
+            float g = mountain[i];
             int mh = g * 32 + 16;
             int h = f * mh;
             int w = 1;
@@ -23,19 +76,17 @@ void create_world(int p, int q, world_func func, void *arg) {
                 w = 2;
             }
             // sand and grass terrain
-            for (int y = 0; y < h; y++) {
-                func(x, y, z, w * flag, arg);
-            }
+            func(x, 0, z, h, w * flag, arg);
             if (w == 1) {
                 if (SHOW_PLANTS) {
                     // grass
-                    if (simplex2(-x * 0.1, z * 0.1, 4, 0.8, 2) > 0.6) {
-                        func(x, h, z, 17 * flag, arg);
+                    if (grass[i] > 0.6) {
+                        func(x, h, z, 1, 17 * flag, arg);
                     }
                     // flowers
-                    if (simplex2(x * 0.05, -z * 0.05, 4, 0.8, 2) > 0.7) {
-                        int w = 18 + simplex2(x * 0.1, z * 0.1, 4, 0.8, 2) * 7;
-                        func(x, h, z, w * flag, arg);
+                    if (flower[i] > 0.7) {
+                        int w = 18 + flower_type[i] * 7;
+                        func(x, h, z, 1, w * flag, arg);
                     }
                 }
                 // trees
@@ -45,33 +96,57 @@ void create_world(int p, int q, world_func func, void *arg) {
                 {
                     ok = 0;
                 }
-                if (ok && simplex2(x, z, 6, 0.5, 2) > 0.84) {
-                    for (int y = h + 3; y < h + 8; y++) {
-                        for (int ox = -3; ox <= 3; ox++) {
-                            for (int oz = -3; oz <= 3; oz++) {
+                if (ok && tree[i] > 0.84) {
+                    // the leaves of each column form one contiguous span
+                    for (int ox = -3; ox <= 3; ox++) {
+                        for (int oz = -3; oz <= 3; oz++) {
+                            int y0 = 0, n = 0;
+                            for (int y = h + 3; y < h + 8; y++) {
                                 int d = (ox * ox) + (oz * oz) +
                                     (y - (h + 4)) * (y - (h + 4));
                                 if (d < 11) {
-                                    func(x + ox, y, z + oz, 15, arg);
+                                    y0 = n ? y0 : y;
+                                    n++;
                                 }
                             }
+                            if (n) {
+                                func(x + ox, y0, z + oz, n, 15, arg);
+                            }
                         }
                     }
-                    for (int y = h; y < h + 7; y++) {
-                        func(x, y, z, 5, arg);
-                    }
+                    func(x, h, z, 7, 5, arg);
                 }
             }
             // clouds
             if (SHOW_CLOUDS) {
-                for (int y = 64; y < 72; y++) {
-                    if (simplex3(
-                        x * 0.01, y * 0.1, z * 0.01, 8, 0.5, 2) > 0.75)
-                    {
-                        func(x, y, z, 16 * flag, arg);
+                int n = 0;
+                for (int y = CLOUD_BOTTOM; y <= CLOUD_TOP; y++) {
+                    if (y < CLOUD_TOP && cloud[y - CLOUD_BOTTOM][i] > 0.75) {
+                        n++;
+                    }
+                    else if (n) {
+                        func(x, y - n, z, n, 16 * flag, arg);
+                        n = 0;
                     }
                 }
             }
         }
     }
 }
+
+typedef struct {
+    world_func func;
+    void *arg;
+} WorldBlocks;
+
+static void world_blocks(int x, int y, int z, int n, int w, void *arg) {
+    WorldBlocks *blocks = (WorldBlocks *)arg;
+    for (int i = 0; i < n; i++) {
+        blocks->func(x, y + i, z, w, blocks->arg);
+    }
+}
+
+void create_world(int p, int q, world_func func, void *arg) {
+    WorldBlocks blocks = {func, arg};
+    create_world_runs(p, q, world_blocks, &blocks);
+}
@@ -3,6 +3,10 @@
 
 typedef void (*world_func)(int, int, int, int, void *);
 
+// x, y, z, n, w: a vertical span of n blocks starting at y
+typedef void (*world_run_func)(int, int, int, int, int, void *);
+
 void create_world(int p, int q, world_func func, void *arg);
+void create_world_runs(int p, int q, world_run_func func, void *arg);
 
 #endif
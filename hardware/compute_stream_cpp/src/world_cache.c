@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "tinycthread.h"
+#include "world_cache.h"
+
+#define ROW (CHUNK_SIZE + 2)
+#define COLUMNS (ROW * ROW)
+
+// a run emitted after the terrain of a column: plants, leaves, trunks
+// and clouds, replayed in their original order
+typedef struct {
+    unsigned short column;
+    signed char dx;
+    signed char dz;
+    unsigned char y;
+    unsigned char n;
+    signed char w;
+} Feature;
+
+typedef struct {
+    int p;
+    int q;
+    int refs;
+    unsigned int used;
+    unsigned int bytes;
+    unsigned char height[COLUMNS];
+    signed char biome[COLUMNS];
+    int feature_count;
+    int feature_capacity;
+    Feature *features;
+} WorldEntry;
+
+typedef struct {
+    WorldEntry *entry;
+    int column;
+    int ox;
+    int oz;
+    world_run_func func;
+    void *arg;
+} Recorder;
+
+static mtx_t mtx;
+static int max_bytes = 0;
+static WorldEntry **entries;
+static int entry_count;
+static int entry_capacity;
+static unsigned int tick;
+static WorldCacheStats stats;
+
+void world_cache_init(int bytes) {
+    mtx_init(&mtx, mtx_plain);
+    max_bytes = bytes;
+    entries = 0;
+    entry_count = entry_capacity = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+static void free_entry(WorldEntry *entry) {
+    free(entry->features);
+    free(entry);
+}
+
+void world_cache_free() {
+    for (int i = 0; i < entry_count; i++) {
+        free_entry(entries[i]);
+    }
+    free(entries);
+    entries = 0;
+    entry_count = entry_capacity = 0;
+    max_bytes = 0;
+    mtx_destroy(&mtx);
+}
+
+void world_cache_stats(WorldCacheStats *result) {
+    mtx_lock(&mtx);
+    *result = stats;
+    result->count = entry_count;
+    mtx_unlock(&mtx);
+}
+
+static WorldEntry *find_entry(int p, int q) {
+    for (int i = 0; i < entry_count; i++) {
+        WorldEntry *entry = entries[i];
+        if (entry->p == p && entry->q == q) {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+static void evict() {
+    while (stats.bytes > (unsigned int)max_bytes) {
+        int index = -1;
+        for (int i = 0; i < entry_count; i++) {
+            WorldEntry *entry = entries[i];
+            if (entry->refs == 0 &&
+                (index < 0 || entry->used < entries[index]->used))
+            {
+                index = i;
+            }
+        }
+        if (index < 0) {
+            return;
+        }
+        stats.bytes -= entries[index]->bytes;
+        stats.evictions++;
+        free_entry(entries[index]);
+        entries[index] = entries[--entry_count];
+    }
+}
+
+static void record_run(int x, int y, int z, int n, int w, void *arg) {
+    Recorder *recorder = (Recorder *)arg;
+    WorldEntry *entry = recorder->entry;
+    int dx = x - recorder->ox;
+    int dz = z - recorder->oz;
+    recorder->func(x, y, z, n, w, recorder->arg);
+    if (y == 0) {
+        // every column starts with its terrain, the only run at y = 0
+        recorder->column = dx * ROW + dz;
+        entry->height[recorder->column] = n;
+        entry->biome[recorder->column] = w;
+        return;
+    }
+    if (entry->feature_count == entry->feature_capacity) {
+        entry->feature_capacity = entry->feature_capacity * 2 + 64;
+        entry->features = (Feature *)realloc(entry->features,
+            sizeof(Feature) * entry->feature_capacity);
+    }
+    Feature *feature = entry->features + entry->feature_count++;
+    feature->column = recorder->column;
+    feature->dx = dx;
+    feature->dz = dz;
+    feature->y = y;
+    feature->n = n;
+    feature->w = w;
+}
+
+static void replay(WorldEntry *entry, world_run_func func, void *arg) {
+    int ox = entry->p * CHUNK_SIZE - 1;
+    int oz = entry->q * CHUNK_SIZE - 1;
+    Feature *feature = entry->features;
+    Feature *end = feature + entry->feature_count;
+    for (int i = 0; i < COLUMNS; i++) {
+        if (!entry->height[i]) {
+            continue;
+        }
+        func(ox + i / ROW, 0, oz + i % ROW,
+            entry->height[i], entry->biome[i], arg);
+        for (; feature < end && feature->column == i; feature++) {
+            func(ox + feature->dx, feature->y, oz + feature->dz,
+                feature->n, feature->w, arg);
+        }
+    }
+}
+
+void world_cache_create(int p, int q, world_run_func func, void *arg) {
+    if (max_bytes <= 0) {
+        create_world_runs(p, q, func, arg);
+        return;
+    }
+    mtx_lock(&mtx);
+    WorldEntry *entry = find_entry(p, q);
+    if (entry) {
+        entry->refs++;
+        entry->used = ++tick;
+        stats.hits++;
+        mtx_unlock(&mtx);
+        replay(entry, func, arg);
+        mtx_lock(&mtx);
+        entry->refs--;
+        mtx_unlock(&mtx);
+        return;
+    }
+    stats.misses++;
+    mtx_unlock(&mtx);
+    entry = (WorldEntry *)calloc(1, sizeof(WorldEntry));
+    entry->p = p;
+    entry->q = q;
+    Recorder recorder = {
+        entry, 0, p * CHUNK_SIZE - 1, q * CHUNK_SIZE - 1, func, arg};
+    create_world_runs(p, q, record_run, &recorder);
+    entry->features = (Feature *)realloc(entry->features,
+        sizeof(Feature) * (entry->feature_count + 1));
+    entry->bytes = sizeof(WorldEntry) +
+        sizeof(Feature) * entry->feature_count;
+    mtx_lock(&mtx);
+    if (find_entry(p, q)) {
+        // another worker generated it first
+        mtx_unlock(&mtx);
+        free_entry(entry);
+        return;
+    }
+    if (entry_count == entry_capacity) {
+        entry_capacity = entry_capacity * 2 + 64;
+        entries = (WorldEntry **)realloc(entries,
+            sizeof(WorldEntry *) * entry_capacity);
+    }
+    entry->used = ++tick;
+    entries[entry_count++] = entry;
+    stats.bytes += entry->bytes;
+    evict();
+    mtx_unlock(&mtx);
+}
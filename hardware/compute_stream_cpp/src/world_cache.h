@@ -0,0 +1,19 @@
+#ifndef _world_cache_h_
+#define _world_cache_h_
+
+#include "world.h"
+
+typedef struct {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int evictions;
+    unsigned int count;
+    unsigned int bytes;
+} WorldCacheStats;
+
+void world_cache_init(int max_bytes);
+void world_cache_free();
+void world_cache_create(int p, int q, world_run_func func, void *arg);
+void world_cache_stats(WorldCacheStats *stats);
+
+#endif
@@ -0,0 +1,207 @@
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "calib.h"
+#include "lodepng.h"
+#include "warp.h"
+
+// native fit_images from compute.py: fits the texture and diopter maps to
+// the slm and warps the texture onto the oled
+
+#define SLM_WIDTH 4000
+#define SLM_HEIGHT 2464
+#define OLED_SIZE 2560
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int check(
+    const char *name, const unsigned char *a, const unsigned char *b,
+    int size)
+{
+    // float and double mappings may round a sample to the neighbouring
+    // value, anything larger is reported as a mismatch
+    int worst = 0;
+    long off = 0;
+    long bad = 0;
+    double total = 0;
+    for (long i = 0; i < (long)size * size * 4; i++) {
+        int d = abs(a[i] - b[i]);
+        worst = d > worst ? d : worst;
+        off += d > 0;
+        bad += d > 1;
+        total += d;
+    }
+    printf("%s: %ld values differ, %ld by more than 1, max %d, "
+        "mean %.3f\n", name, off, bad, worst,
+        total / ((double)size * size * 4));
+    return bad == 0;
+}
+
+static unsigned char *load_oled(const char *path) {
+    // an oled frame rendered by the gl pass, either the rgb raw file of a
+    // recording, stored bottom row first, or a png stored top row first,
+    // returned as rgba in the row order of warp_oled
+    int size = OLED_SIZE;
+    unsigned char *result = 0;
+    const char *extension = strrchr(path, '.');
+    if (extension && strcmp(extension, ".raw") == 0) {
+        FILE *file = fopen(path, "rb");
+        if (!file) {
+            fprintf(stderr, "unable to open %s\n", path);
+            return 0;
+        }
+        unsigned char *data = malloc(size * size * 3);
+        size_t count = fread(data, 1, size * size * 3, file);
+        fclose(file);
+        if (count != (size_t)size * size * 3) {
+            fprintf(stderr, "%s is not a %dx%d rgb frame\n",
+                path, size, size);
+            free(data);
+            return 0;
+        }
+        result = malloc(size * size * 4);
+        for (int y = 0; y < size; y++) {
+            const unsigned char *row = data + (size - 1 - y) * size * 3;
+            for (int x = 0; x < size; x++) {
+                unsigned char *pixel = result + (y * size + x) * 4;
+                memcpy(pixel, row + x * 3, 3);
+                pixel[3] = 255;
+            }
+        }
+        free(data);
+        return result;
+    }
+    unsigned int width, height;
+    unsigned int error = lodepng_decode32_file(&result, &width, &height, path);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", path, lodepng_error_text(error));
+        return 0;
+    }
+    if (width != (unsigned int)size || height != (unsigned int)size) {
+        fprintf(stderr, "%s is not %dx%d\n", path, size, size);
+        free(result);
+        return 0;
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    const char *calibration = 0;
+    const char *compare = 0;
+    const char *paths[4];
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int repeat = 1;
+    int reference = 0;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-calibration") == 0 && i + 1 < argc) {
+            calibration = argv[++i];
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-check") == 0) {
+            reference = 1;
+        }
+        else if (strcmp(argv[i], "-compare") == 0 && i + 1 < argc) {
+            compare = argv[++i];
+        }
+        else if (positional < 4) {
+            paths[positional++] = argv[i];
+        }
+        else {
+            positional++;
+        }
+    }
+    if (positional != 4 || threads < 1 || repeat < 1) {
+        fprintf(stderr, "usage: %s [-calibration FILE] [-threads N] "
+            "[-repeat N] [-check] [-compare GL_OLED] TEXTURE.png "
+            "DIOPTER.png OLED.png SLM.png\n", argv[0]);
+        return 1;
+    }
+    Calibration calib;
+    calib_default(&calib);
+    if (calibration && !calib_load(&calib, calibration)) {
+        fprintf(stderr, "unable to load calibration %s\n", calibration);
+        return 1;
+    }
+    unsigned char *texture;
+    unsigned char *diopter;
+    unsigned int width, height, diopter_width, diopter_height;
+    unsigned int error = lodepng_decode32_file(
+        &texture, &width, &height, paths[0]);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", paths[0], lodepng_error_text(error));
+        return 1;
+    }
+    error = lodepng_decode_file(
+        &diopter, &diopter_width, &diopter_height, paths[1], LCT_GREY, 8);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", paths[1], lodepng_error_text(error));
+        return 1;
+    }
+
+    unsigned char *slm_texture = malloc(SLM_WIDTH * SLM_HEIGHT * 4);
+    unsigned char *slm = malloc(SLM_WIDTH * SLM_HEIGHT);
+    unsigned char *oled = malloc(OLED_SIZE * OLED_SIZE * 4);
+    warp_fit(texture, width, height, 4,
+        slm_texture, SLM_WIDTH, SLM_HEIGHT);
+    warp_fit(diopter, diopter_width, diopter_height, 1,
+        slm, SLM_WIDTH, SLM_HEIGHT);
+
+    double start = now();
+    for (int i = 0; i < repeat; i++) {
+        warp_oled(&calib, slm_texture, SLM_WIDTH, SLM_HEIGHT,
+            oled, OLED_SIZE, threads);
+    }
+    double elapsed = (now() - start) / repeat;
+    printf("warp: %.2f ms per frame, %d threads, %s\n",
+        elapsed * 1000, threads, warp_simd() ? "avx2" : "scalar");
+
+    int result = 0;
+    if (reference) {
+        unsigned char *expected = malloc(OLED_SIZE * OLED_SIZE * 4);
+        warp_oled_reference(&calib, slm_texture, SLM_WIDTH, SLM_HEIGHT,
+            expected, OLED_SIZE);
+        result = check("reference", oled, expected, OLED_SIZE) ? 0 : 1;
+        free(expected);
+    }
+    if (compare) {
+        unsigned char *expected = load_oled(compare);
+        if (!expected || !check("gl", oled, expected, OLED_SIZE)) {
+            result = 1;
+        }
+        free(expected);
+    }
+
+    // the oled image is saved as rgb, as compute.py does
+    for (int i = 0; i < OLED_SIZE * OLED_SIZE; i++) {
+        memmove(oled + i * 3, oled + i * 4, 3);
+    }
+    error = lodepng_encode24_file(paths[2], oled, OLED_SIZE, OLED_SIZE);
+    if (!error) {
+        error = lodepng_encode_file(
+            paths[3], slm, SLM_WIDTH, SLM_HEIGHT, LCT_GREY, 8);
+    }
+    if (error) {
+        fprintf(stderr, "%s\n", lodepng_error_text(error));
+        result = 1;
+    }
+    free(texture);
+    free(diopter);
+    free(slm_texture);
+    free(slm);
+    free(oled);
+    return result;
+}